@@ -136,6 +136,28 @@ brelse(struct buf *b)
   release(&bcache.lock);
 }
 
+// Drop the cached copy of a block, if there is one, after it
+// was written to the disk without going through the cache.
+// The next bread() of it reads the new contents.
+void
+bforget(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  acquire(&bcache.lock);
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      release(&bcache.lock);
+      acquiresleep(&b->lock);
+      b->valid = 0;
+      brelse(b);
+      return;
+    }
+  }
+  release(&bcache.lock);
+}
+
 void
 bpin(struct buf *b) {
   acquire(&bcache.lock);
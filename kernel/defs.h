@@ -9,6 +9,7 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct page_data;
+struct timer;
 
 // bio.c
 void            binit(void);
@@ -16,6 +17,7 @@ struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
+void            bforget(uint, uint);
 void            bunpin(struct buf*);
 
 // console.c
@@ -58,8 +60,27 @@ void            itrunc(struct inode*);
 int		        createSwapFile(struct proc* p);
 int	          	readFromSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size);
 int		        writeToSwapFile(struct proc* p, char* buffer, uint placeOnFile, uint size);
+int		        readPagesFromSwapFile(struct proc* p, char** buffers, uint* placesOnFile, int n);
+int		        writePagesToSwapFile(struct proc* p, char** buffers, uint* placesOnFile, int n);
+int		        extendSwapFile(struct proc* p, uint size);
 int		        removeSwapFile(struct proc* p);
 
+// rmap.c
+void            rmapinit(void);
+int             rmap_add(uint64, pagetable_t, uint64);
+void            rmap_remove(uint64, pagetable_t, uint64);
+int             rmap_update(uint64, uint64, uint64);
+
+// pressure.c
+void            pressureinit(void);
+void            pressure_tick(void);
+int             pressure_wait(int);
+void            stall_begin(void);
+void            stall_end(void);
+void            pressure_fault(void);
+void            loadctl_wait(void);
+void            loadctld(void*);
+
 // ramdisk.c
 void            ramdiskinit(void);
 void            ramdiskintr(void);
@@ -69,13 +90,33 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+int             kfreepages(void);
+void*           kzalloc(void);
+void            kzerod(void*);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
+void            log_wait(uint);
 void            begin_op(void);
 void            end_op(void);
 
+// memgroup.c
+void            memgroupinit(void);
+void            mg_fork(struct proc*, struct proc*);
+void            mg_exit(struct proc*);
+void            mg_sync(struct proc*);
+int             mg_full(struct proc*);
+int             mg_swap_full(struct proc*);
+int             mg_swap_room(struct proc*);
+int             mg_create(int, int);
+int             mg_id(struct proc*);
+
+// mglru.c
+void            mglru_init(struct proc*);
+void            mglru_add(struct proc*, struct page_data*);
+int             get_MGLRU_index(void);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
@@ -91,14 +132,24 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             clone(uint64, uint64, uint64);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+void            prepage(struct proc*);
+void            loadctl_pick(void);
+int             oom_kill(void);
+int             nice(int);
+struct proc*    kthread_create(void (*)(void*), void*, char*);
+int             kthread_should_stop(void);
+void            kthread_stop(struct proc*);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
+struct proc*    mmproc(void);
+void            vm_lock(struct proc*);
+void            vm_unlock(struct proc*);
 void            procinit(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
@@ -113,6 +164,7 @@ int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
 int             lazy_growproc(int n);
 int             swapfile_to_ram(uint64 va, pte_t *pte, int ram_arr_index);
+void            init_page(struct proc *p, struct page_data *page_data, uint64 va);
 void            remove_page(struct page_data *page_data);
 int             count_pages(struct page_data *paging_info, int flag);
 
@@ -154,12 +206,22 @@ void            syscall();
 struct inode*	create(char *path, short type, short major, short minor);
 int				isdirempty(struct inode *dp);
 
+// timer.c
+void            timerwheelinit(void);
+void            timer_add(struct timer*, int);
+int             timer_del(struct timer*);
+void            timer_tick(void);
+int             timer_sleep(int);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            tick_stop(void);
+void            tick_start(void);
+void            kick(int);
 
 // uart.c
 void            uartinit(void);
@@ -170,6 +232,10 @@ int             uartgetc(void);
 
 // vm.c
 void            kvminit(void);
+int             kvmmapstack(uint64);
+void            kvmunmapstack(uint64);
+void            kvmsync(void);
+void            tlb_shootdown(pagetable_t);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
@@ -188,7 +254,17 @@ int             copyinstr(pagetable_t, char *, uint64, uint64);
 pte_t *         walk(pagetable_t pagetable, uint64 va, int alloc);
 int             mappage(pagetable_t, uint64, uint64, int);
 int             lazy_alloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz);
+void            ptaccount(pagetable_t, int);
+int             uvmptpages(pagetable_t, int);
 void            handle_page_fault(void);
+int             madvise(uint64, uint64, int);
+int             mlock(uint64, uint64);
+int             munlock(uint64, uint64);
+int             evictable(struct proc*, struct page_data*);
+void            adapt_refault(struct proc*, uint64);
+int             can_grow(struct proc*);
+int             free_ram_index(struct proc*);
+void            swap_out_all(struct proc*);
 
 // plic.c
 void            plicinit(void);
@@ -199,6 +275,7 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_writev(uint, char**, uint*, int);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
@@ -6,6 +6,9 @@
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
+#include "mman.h"
+
+extern struct spinlock wait_lock; // proc.c
 
 static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
 
@@ -20,6 +23,14 @@ int exec(char *path, char **argv)
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
+  // not while threads share the address space it would replace.
+  // clone() and exit() count them under wait_lock.
+  acquire(&wait_lock);
+  i = p->mm != p || p->nthreads > 0;
+  release(&wait_lock);
+  if(i)
+    return -1;
+
   begin_op();
 
   if((ip = namei(path)) == 0){
@@ -102,31 +113,22 @@ int exec(char *path, char **argv)
         remove_page(&p->ram[i]);
         remove_page(&p->swap[i]);
       }
+      memset(p->advice, MADV_NORMAL, sizeof(p->advice));
+      memset(p->ghost, 0, sizeof(p->ghost));
+      p->arc_target = 0;
+      mglru_init(p);
+      memset(&p->adapt, 0, sizeof(p->adapt));
+      p->nlocked = 0;
 
-      struct page_data *page;
       for (int i = 0; i * PGSIZE < sz; i++) {
-        page = &p->ram[i];
-        page->va = i * PGSIZE;
-        page->used = 1;
-        page->offset = -1;
-
-        #ifdef NFUA
-          page->age = 0;
-        #endif
-
-        #ifdef LAPA
-          page->age = 0xFFFFFFFF;
-        #endif 
-
-        #ifdef SCFIFO
-          page->fifo_time = p->fifo_counter++;
-        #endif
+        init_page(p, &p->ram[i], i * PGSIZE);
 
         if (removeSwapFile(p) == -1)
           panic("failure when trying to remove swapfile");
         if (createSwapFile(p) == -1)
           panic("failure when trying to create swapfile");
       }
+      mg_sync(p);
     }
   #endif
 
@@ -144,6 +146,7 @@ int exec(char *path, char **argv)
   // Commit to the user image.
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
+  p->ptpages = uvmptpages(pagetable, 2);
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
@@ -114,6 +114,11 @@ fileread(struct file *f, uint64 addr, int n)
   if(f->type == FD_PIPE){
     r = piperead(f->pipe, addr, n);
   } else if(f->type == FD_DEVICE){
+    if(f->major >= 0 && f->major < NDEV && devsw[f->major].readat){
+      if((r = devsw[f->major].readat(1, addr, f->off, n)) > 0)
+        f->off += r;
+      return r;
+    }
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
     r = devsw[f->major].read(1, addr, n);
@@ -33,8 +33,10 @@ struct inode {
 struct devsw {
   int (*read)(int, uint64, int);
   int (*write)(int, uint64, int);
+  int (*readat)(int, uint64, uint, int); // read at file offset, if set
 };
 
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define PRESSURE 2
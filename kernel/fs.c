@@ -806,4 +806,127 @@ readFromSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size)
 {
   p->swapFile->off = placeOnFile;
   return kfileread(p->swapFile, (uint64)buffer,  size);
-}
\ No newline at end of file
+}
+
+//read n pages in one batch, taking the inode lock once:
+//buffers[i] gets the page at placesOnFile[i]. sorted
+//offsets make the disk reads sequential.
+//return 0 on success, -1 when error
+int
+readPagesFromSwapFile(struct proc * p, char** buffers, uint* placesOnFile, int n)
+{
+  struct inode *ip = p->swapFile->ip;
+  int r = 0;
+
+  ilock(ip);
+  for(int i = 0; i < n && r == 0; i++)
+    if(readi(ip, 0, (uint64)buffers[i], placesOnFile[i], PGSIZE) != PGSIZE)
+      r = -1;
+  iunlock(ip);
+  return r;
+}
+
+#define SWAPSEGS 8 // pieces of memory per disk write, at most NUM-2 (virtio.h)
+
+//write the run of nblocks swap blocks at start, gathered from
+//nsegs pieces of memory, and drop any stale cached copies.
+static void
+swapwrite(uint dev, uint start, uint nblocks, char **data, uint *len, int nsegs)
+{
+  virtio_disk_writev(start, data, len, nsegs);
+  for(uint b = start; b < start + nblocks; b++)
+    bforget(dev, b);
+}
+
+//write n pages in swapfile order: buffers[i] goes to
+//placesOnFile[i], which should be sorted, so the disk
+//sees one sequential run. pages below the end of the file
+//go straight from their frames to the disk, in one request
+//for each run of consecutive blocks, and not through the log
+//or the buffer cache: swap contents are worthless after a
+//crash, and their blocks are already allocated. a block is
+//only written once no transaction still to be installed has
+//it, which would undo the write; its cached copy is dropped
+//after. a page past the end still grows the file through a
+//transaction.
+//return 0 on success, -1 when error
+int
+writePagesToSwapFile(struct proc * p, char** buffers, uint* placesOnFile, int n)
+{
+  struct inode *ip = p->swapFile->ip;
+  char *data[SWAPSEGS], *mem;
+  uint len[SWAPSEGS];
+  uint start = 0, nblocks = 0, bno, off;
+  int nsegs = 0, r = 0;
+
+  ilock(ip);
+  for(int i = 0; i < n && r == 0; i++){
+    if(placesOnFile[i] + PGSIZE > ip->size){
+      iunlock(ip);
+      p->swapFile->off = placesOnFile[i];
+      if(kfilewrite(p->swapFile, (uint64)buffers[i], PGSIZE) != PGSIZE)
+        r = -1;
+      ilock(ip);
+      continue;
+    }
+    for(off = 0; off < PGSIZE; off += BSIZE){
+      bno = bmap(ip, (placesOnFile[i] + off) / BSIZE);
+      mem = buffers[i] + off;
+      log_wait(bno);
+      if(nsegs > 0 && bno == start + nblocks &&
+         mem == data[nsegs-1] + len[nsegs-1]){
+        // the run and its last piece of memory go on
+        len[nsegs-1] += BSIZE;
+      } else if(nsegs > 0 && bno == start + nblocks && nsegs < SWAPSEGS){
+        // the run goes on from another piece
+        data[nsegs] = mem;
+        len[nsegs++] = BSIZE;
+      } else {
+        if(nsegs > 0)
+          swapwrite(ip->dev, start, nblocks, data, len, nsegs);
+        start = bno;
+        nblocks = 0;
+        data[0] = mem;
+        len[0] = BSIZE;
+        nsegs = 1;
+      }
+      nblocks++;
+    }
+  }
+  if(r == 0 && nsegs > 0)
+    swapwrite(ip->dev, start, nblocks, data, len, nsegs);
+  iunlock(ip);
+  return r;
+}
+
+//grow the swap file of proc p with zeros to at least size
+//bytes; a file can't be written past its end, so this lets
+//a page be written anywhere below size.
+//return 0 on success, -1 when error
+int
+extendSwapFile(struct proc * p, uint size)
+{
+  struct inode *ip = p->swapFile->ip;
+  char *zeros;
+  uint end, n;
+  int r = 0;
+
+  ilock(ip);
+  end = ip->size;
+  iunlock(ip);
+  if(end >= size)
+    return 0;
+
+  if((zeros = kalloc()) == 0)
+    return -1;
+  memset(zeros, 0, PGSIZE);
+  while(end < size && r == 0){
+    n = PGSIZE - end % PGSIZE;
+    p->swapFile->off = end;
+    if(kfilewrite(p->swapFile, (uint64)zeros, n) != n)
+      r = -1;
+    end += n;
+  }
+  kfree(zeros);
+  return r;
+}
@@ -9,6 +9,8 @@
 #include "riscv.h"
 #include "defs.h"
 
+#define NZERO 64 // zeroed pages kzerod keeps in stock
+
 void freerange(void *pa_start, void *pa_end);
 
 extern char end[]; // first address after kernel.
@@ -21,6 +23,9 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
+  int nfree;             // pages on the freelist
+  struct run *zerolist;  // pages kzerod has zeroed
+  int nzero;             // pages on the zerolist
 } kmem;
 
 void
@@ -59,6 +64,7 @@ kfree(void *pa)
   acquire(&kmem.lock);
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
   release(&kmem.lock);
 }
 
@@ -72,11 +78,93 @@ kalloc(void)
 
   acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.nfree--;
+  } else if((r = kmem.zerolist) != 0){
+    // the zeroed stock is free memory too
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+  }
   release(&kmem.lock);
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
 }
+
+// Allocate one zeroed page, taking it from the stock
+// kzerod keeps when there is one.
+// Returns 0 if the memory cannot be allocated.
+void *
+kzalloc(void)
+{
+  struct run *r;
+  int low = 0;
+
+  acquire(&kmem.lock);
+  r = kmem.zerolist;
+  if(r){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+    low = kmem.nzero < NZERO / 2;
+  }
+  release(&kmem.lock);
+
+  if(low)
+    wakeup(&kmem.zerolist);
+
+  if(r){
+    r->next = 0; // the only word that was not zero
+    return (void*)r;
+  }
+  if((r = kalloc()) != 0)
+    memset((char*)r, 0, PGSIZE);
+  return (void*)r;
+}
+
+// Kernel thread that zeroes free pages ahead of time, so
+// that sbrk() and faults on fresh pages find them ready.
+// Once the stock is full it sleeps until kzalloc() has
+// used up half of it.
+void
+kzerod(void *arg)
+{
+  struct run *r;
+
+  while(!kthread_should_stop()){
+    acquire(&kmem.lock);
+    while(kmem.nzero >= NZERO && !kthread_should_stop())
+      sleep(&kmem.zerolist, &kmem.lock);
+    release(&kmem.lock);
+    if(kthread_should_stop())
+      break;
+
+    if((r = kalloc()) == 0){
+      // out of memory: try again on the next tick
+      timer_sleep(1);
+      continue;
+    }
+    memset((char*)r, 0, PGSIZE);
+
+    acquire(&kmem.lock);
+    r->next = kmem.zerolist;
+    kmem.zerolist = r;
+    kmem.nzero++;
+    release(&kmem.lock);
+  }
+}
+
+// Number of free pages, counting the zeroed stock.
+// Only a snapshot: it may change as soon as the lock
+// is released.
+int
+kfreepages(void)
+{
+  int n;
+
+  acquire(&kmem.lock);
+  n = kmem.nfree + kmem.nzero;
+  release(&kmem.lock);
+  return n;
+}
@@ -202,6 +202,27 @@ commit()
   }
 }
 
+// Wait until block blockno is in no transaction that is still
+// to be installed. A write to its home location that bypasses
+// the log is undone when install_trans() copies a logged
+// version of the block over it, so such a write waits first.
+void
+log_wait(uint blockno)
+{
+  int i;
+
+  acquire(&log.lock);
+  for(;;){
+    for(i = 0; i < log.lh.n; i++)
+      if(log.lh.block[i] == blockno)
+        break;
+    if(i == log.lh.n)
+      break;
+    sleep(&log, &log.lock);
+  }
+  release(&log.lock);
+}
+
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
 // commit()/write_log() will do the disk write.
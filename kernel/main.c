@@ -18,8 +18,10 @@ main()
     printf("\n");
     kinit();         // physical page allocator
     kvminit();       // create kernel page table
+    rmapinit();      // physical frame reverse map
     kvminithart();   // turn on paging
     procinit();      // process table
+    memgroupinit();  // memory groups
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
@@ -27,8 +29,12 @@ main()
     binit();         // buffer cache
     iinit();         // inode cache
     fileinit();      // file table
+    pressureinit();  // memory pressure accounting
+    timerwheelinit(); // kernel timers
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
+    kthread_create(kzerod, 0, "kzerod"); // page zeroing
+    kthread_create(loadctld, 0, "loadctld"); // load control
     __sync_synchronize();
     started = 1;
   } else {
@@ -0,0 +1,229 @@
+//
+// Memory groups.
+//
+// A process and its descendants share a memory group, and groups
+// nest: every group except the root has a parent. A group may cap
+// the resident frames and the swapped pages of all its members,
+// and every page charged to a group is also charged to each of
+// its ancestors, so a limit applies to the whole subtree below it.
+//
+// When a member needs a new frame and any group on its chain is
+// at its frame limit, the member evicts one of its own pages
+// instead of taking a free slot, whatever MAX_PSYC_PAGES would
+// allow. When a group is at its swap limit, members cannot grow
+// by pushing pages out to the swapfile.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+struct memgroup {
+  int refs;                // member processes and child groups
+  struct memgroup *parent;
+  int frame_limit;         // max resident frames, 0 if unlimited
+  int swap_limit;          // max swapped pages, 0 if unlimited
+  int frames;              // resident frames charged to the group
+  int swapped;             // swapped pages charged to the group
+};
+
+struct {
+  struct spinlock lock;
+  struct memgroup group[NMEMGROUP];
+} mg;
+
+// the root group, which every process starts in.
+#define ROOTGROUP (&mg.group[0])
+
+void
+memgroupinit(void)
+{
+  initlock(&mg.lock, "memgroup");
+  ROOTGROUP->refs = 1; // never freed
+}
+
+// add frames and swapped pages to g and its ancestors.
+// mg.lock must be held.
+static void
+charge(struct memgroup *g, int frames, int swapped)
+{
+  for(; g != 0; g = g->parent){
+    g->frames += frames;
+    g->swapped += swapped;
+  }
+}
+
+// drop a reference to g, freeing it and dropping its
+// reference on its parent when it was the last.
+// mg.lock must be held.
+static void
+put(struct memgroup *g)
+{
+  while(g != 0 && --g->refs == 0){
+    struct memgroup *parent = g->parent;
+    g->parent = 0;
+    g = parent;
+  }
+}
+
+// put a new process in the group of its parent.
+void
+mg_fork(struct proc *np, struct proc *p)
+{
+  acquire(&mg.lock);
+  np->memgroup = p->memgroup ? p->memgroup : ROOTGROUP;
+  np->memgroup->refs++;
+  np->mg_frames = 0;
+  np->mg_swapped = 0;
+  release(&mg.lock);
+}
+
+// the process is going away: take back what it was
+// charged and leave its group.
+void
+mg_exit(struct proc *p)
+{
+  acquire(&mg.lock);
+  if(p->memgroup){
+    charge(p->memgroup, -p->mg_frames, -p->mg_swapped);
+    put(p->memgroup);
+  }
+  p->memgroup = 0;
+  p->mg_frames = 0;
+  p->mg_swapped = 0;
+  release(&mg.lock);
+}
+
+// bring the group charges of p in line with its
+// p->ram and p->swap. called after they change.
+// p->memgroup, p->mg_frames and p->mg_swapped are
+// only read and written under mg.lock, so callers in
+// different threads cannot lose each other's charges.
+void
+mg_sync(struct proc *p)
+{
+  int frames = 0, swapped = 0;
+
+  #ifndef NONE
+    if(p->pid > 2){
+      frames = count_pages(p->ram, 0);
+      swapped = count_pages(p->swap, 0);
+    }
+  #endif
+
+  acquire(&mg.lock);
+  if(p->memgroup){
+    charge(p->memgroup, frames - p->mg_frames, swapped - p->mg_swapped);
+    p->mg_frames = frames;
+    p->mg_swapped = swapped;
+  }
+  release(&mg.lock);
+}
+
+// is any group above p at its resident frame limit?
+int
+mg_full(struct proc *p)
+{
+  struct memgroup *g;
+  int full = 0;
+
+  acquire(&mg.lock);
+  for(g = p->memgroup; g != 0; g = g->parent)
+    if(g->frame_limit && g->frames >= g->frame_limit)
+      full = 1;
+  release(&mg.lock);
+  return full;
+}
+
+// is any group above p at its swap limit?
+int
+mg_swap_full(struct proc *p)
+{
+  struct memgroup *g;
+  int full = 0;
+
+  acquire(&mg.lock);
+  for(g = p->memgroup; g != 0; g = g->parent)
+    if(g->swap_limit && g->swapped >= g->swap_limit)
+      full = 1;
+  release(&mg.lock);
+  return full;
+}
+
+// how many more pages p may swap out before a group
+// above it reaches its swap limit.
+int
+mg_swap_room(struct proc *p)
+{
+  struct memgroup *g;
+  int room = MAX_TOTAL_PAGES;
+
+  acquire(&mg.lock);
+  for(g = p->memgroup; g != 0; g = g->parent)
+    if(g->swap_limit && g->swap_limit - g->swapped < room)
+      room = g->swap_limit - g->swapped;
+  release(&mg.lock);
+  return room > 0 ? room : 0;
+}
+
+// create a group below the caller's group, limited to
+// frame_limit resident frames and swap_limit swapped pages
+// (0 for no limit), and move the caller into it. children
+// forked afterwards join it too. a thread moves the owner of
+// its address space, which is charged for the pages.
+// returns the group id, or -1 if there is no free group.
+int
+mg_create(int frame_limit, int swap_limit)
+{
+  struct proc *p = mmproc();
+  struct memgroup *g;
+
+  if(frame_limit < 0 || swap_limit < 0)
+    return -1;
+
+  // keep faults in other threads from changing its charges
+  vm_lock(p);
+  acquire(&mg.lock);
+  for(g = &mg.group[1]; g < &mg.group[NMEMGROUP]; g++)
+    if(g->refs == 0)
+      break;
+  if(g == &mg.group[NMEMGROUP]){
+    release(&mg.lock);
+    vm_unlock(p);
+    return -1;
+  }
+
+  g->refs = 1; // the caller
+  g->parent = p->memgroup;
+  g->frame_limit = frame_limit;
+  g->swap_limit = swap_limit;
+  g->frames = 0;
+  g->swapped = 0;
+
+  // the old group stays referenced as the parent of g,
+  // so only the caller's charges move.
+  charge(p->memgroup, -p->mg_frames, -p->mg_swapped);
+  charge(g, p->mg_frames, p->mg_swapped);
+  p->memgroup = g;
+  release(&mg.lock);
+  vm_unlock(p);
+
+  return g - mg.group;
+}
+
+// the id of p's group, as mg_create() returned it;
+// 0 for the root group.
+int
+mg_id(struct proc *p)
+{
+  int id;
+
+  acquire(&mg.lock);
+  id = p->memgroup ? p->memgroup - mg.group : 0;
+  release(&mg.lock);
+  return id;
+}
@@ -0,0 +1,192 @@
+//
+// Multi-generational LRU.
+//
+// With SELECTION=MGLRU the resident pages of a process are
+// bucketed into generations numbered by sequence: p->max_seq is
+// the youngest and p->min_seq the oldest, with at most
+// MAX_NR_GENS of them live. p->gens[seq % MAX_NR_GENS] is a mask
+// of the p->ram indices in a generation, so the victim comes out
+// of the oldest non-empty generation without looking at the rest.
+// Masks are cleaned lazily: a bit only counts while the p->ram
+// entry is in use and still carries that generation's sequence.
+//
+// A new page joins the youngest generation. Ageing happens only
+// when eviction has used up all but MIN_NR_GENS generations: a
+// walk of the page table opens a new youngest generation and
+// moves into it every page found with PTE_A set. RISC-V never
+// sets PTE_A on non-leaf entries, so a small Bloom filter of the
+// level-0 page-table pages that had young entries on the last
+// walk decides which ones the next walk visits. The others are
+// caught by looking around the victim's neighbours at eviction
+// time, which puts their page-table page back in the filter.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define MIN_NR_GENS 2  // generations left when ageing kicks in
+#define LOOKAROUND  8  // neighbours checked either side of a victim
+
+// bit of a level-0 page-table page, identified by the va it
+// maps, in the walk filter.
+static uint64
+filter_bit(uint64 va)
+{
+  return 1L << ((va >> 21) % 64);
+}
+
+// start p with empty generations; the first walk visits
+// every page-table page.
+void
+mglru_init(struct proc *p)
+{
+  p->min_seq = 0;
+  p->max_seq = MIN_NR_GENS - 1;
+  for(int i = 0; i < MAX_NR_GENS; i++)
+    p->gens[i] = 0;
+  p->mglru_filter = ~0L;
+}
+
+// put the p->ram entry page into the youngest generation.
+void
+mglru_add(struct proc *p, struct page_data *page)
+{
+  int i = page - p->ram;
+
+  if(page->used && page->gen >= p->min_seq)
+    p->gens[page->gen % MAX_NR_GENS] &= ~(1 << i);
+  page->gen = p->max_seq;
+  p->gens[p->max_seq % MAX_NR_GENS] |= 1 << i;
+}
+
+static struct page_data*
+resident(struct proc *p, uint64 va)
+{
+  struct page_data *page;
+
+  for(page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++)
+    if(page->used && page->va == va)
+      return page;
+  return 0;
+}
+
+// if the page at va was accessed, clear PTE_A and make it young.
+// returns 1 if it was.
+static int
+promote(struct proc *p, pte_t *pte, uint64 va)
+{
+  struct page_data *page;
+
+  if((*pte & (PTE_V | PTE_U | PTE_A)) != (PTE_V | PTE_U | PTE_A))
+    return 0;
+  __sync_fetch_and_and(pte, ~PTE_A);
+  if((page = resident(p, va)) != 0)
+    mglru_add(p, page);
+  return 1;
+}
+
+// open a new youngest generation and walk the level-0 page-table
+// pages in the filter, moving the pages accessed since the last
+// walk into it. the filter is rebuilt from what is found.
+static void
+age(struct proc *p)
+{
+  uint64 filter = p->mglru_filter;
+  pagetable_t l1, l0;
+
+  p->max_seq++;
+  p->gens[p->max_seq % MAX_NR_GENS] = 0;
+  p->mglru_filter = 0;
+
+  for(int i = 0; i <= PX(2, p->sz - 1) && p->sz > 0; i++){
+    if((p->pagetable[i] & PTE_V) == 0 || (p->pagetable[i] & (PTE_R|PTE_W|PTE_X)))
+      continue;
+    l1 = (pagetable_t)PTE2PA(p->pagetable[i]);
+    for(int j = 0; j < 512; j++){
+      uint64 base = ((uint64)i << 30) | ((uint64)j << 21);
+      if(base >= p->sz)
+        break;
+      if((l1[j] & PTE_V) == 0 || (l1[j] & (PTE_R|PTE_W|PTE_X)))
+        continue;
+      if((filter & filter_bit(base)) == 0)
+        continue;
+      l0 = (pagetable_t)PTE2PA(l1[j]);
+      int young = 0;
+      for(int k = 0; k < 512 && base + k * PGSIZE < p->sz; k++)
+        young += promote(p, &l0[k], base + k * PGSIZE);
+      if(young)
+        p->mglru_filter |= filter_bit(base);
+    }
+  }
+}
+
+// the victim at va turned out to be young: make it and its
+// accessed neighbours young, and have the next walk visit their
+// page-table page.
+static void
+lookaround(struct proc *p, uint64 va)
+{
+  uint64 start = va >= LOOKAROUND * PGSIZE ? va - LOOKAROUND * PGSIZE : 0;
+  pte_t *pte;
+
+  // stay within va's level-0 page-table page
+  if(PX(1, start) != PX(1, va))
+    start = va & ~((1L << 21) - 1);
+  for(uint64 a = start; a <= va + LOOKAROUND * PGSIZE && a < p->sz; a += PGSIZE){
+    if(PX(1, a) != PX(1, va))
+      break;
+    if((pte = walk(p->pagetable, a, 0)) != 0)
+      promote(p, pte, a);
+  }
+  p->mglru_filter |= filter_bit(va);
+}
+
+// choose the victim from the oldest generation, ageing when
+// only MIN_NR_GENS generations are left.
+int
+get_MGLRU_index(void)
+{
+  struct proc *p = mmproc();
+  struct page_data *page;
+  pte_t *pte;
+  int i;
+
+  for(page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++)
+    if(evictable(p, page))
+      break;
+  if(page == &p->ram[MAX_PSYC_PAGES])
+    return 0;
+
+  for(;;){
+    uint *mask = &p->gens[p->min_seq % MAX_NR_GENS];
+    while(*mask){
+      for(i = 0; (*mask & (1 << i)) == 0; i++)
+        ;
+      page = &p->ram[i];
+      if(!page->used || page->gen != p->min_seq){
+        *mask &= ~(1 << i);
+        continue;
+      }
+      pte = walk(p->pagetable, page->va, 0);
+      if(!evictable(p, page)){
+        mglru_add(p, page);
+        continue;
+      }
+      if(*pte & PTE_A){
+        lookaround(p, page->va);
+        continue;
+      }
+      return i;
+    }
+
+    // the oldest generation is empty
+    if(p->min_seq + MIN_NR_GENS > p->max_seq)
+      age(p);
+    p->min_seq++;
+  }
+}
@@ -0,0 +1,6 @@
+// madvise() advice values
+#define MADV_NORMAL     0 // no special treatment
+#define MADV_RANDOM     1 // expect random access: no readahead
+#define MADV_SEQUENTIAL 2 // expect sequential access: aggressive readahead, drop-behind
+#define MADV_WILLNEED   3 // will be needed soon: swap in now
+#define MADV_DONTNEED   4 // not needed: drop the page and its frame/swap slot
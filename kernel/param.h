@@ -1,4 +1,4 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      4096  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
@@ -11,6 +11,14 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#ifndef HZ
+#define HZ           10    // clock ticks per second; make HZ=100 for finer timeslices
+#endif
+#define TIMEBASE     10000000 // time CSR cycles per second in qemu
 // Assignment 3
 #define MAX_PSYC_PAGES  16
-#define MAX_TOTAL_PAGES 32
\ No newline at end of file
+#define MAX_TOTAL_PAGES 32
+#define MAX_LOCKED_PAGES 8  // mlock()ed pages per process
+#define MAX_NR_GENS      4  // MGLRU generations per process
+#define NMEMGROUP   16  // maximum number of memory groups
+#define NTHREAD     16  // trapframe slots of an address space, its owner's included
\ No newline at end of file
@@ -0,0 +1,285 @@
+//
+// Memory pressure stall accounting.
+//
+// Time a process spends stalled on memory -- resolving a page
+// fault or evicting a page to make room for sbrk -- is measured
+// with the time CSR and charged to the process (p->stall). The
+// system counts "some" stall time: wall-clock time in which at
+// least one process was stalled, so stalls overlapping on
+// different harts count once. Every PSI_WINDOW clock ticks the
+// system time for the window is turned into a pressure figure:
+// the per-mille share of wall-clock time that was spent stalled.
+//
+// The figures are readable as text through the "pressure"
+// device, and pressurewait() blocks until the pressure
+// reaches a threshold, so user space can shed load before
+// throughput collapses.
+//
+// Page faults are counted per window too. When a window sees
+// LOADCTL_HIGH or more, the system is thrashing and load
+// control steps in: the loadctld kernel thread has the process
+// with the most resident pages swap itself out and sleep. Once a
+// window sees fewer than LOADCTL_LOW faults, one suspended
+// process is let go.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "defs.h"
+
+#define PSI_WINDOW  HZ // clock ticks per pressure window, a second
+#define TIMEBASE_US (TIMEBASE / 1000000) // time CSR cycles per microsecond
+#define LOADCTL_HIGH 64 // faults per window that start load control
+#define LOADCTL_LOW  16 // faults per window that let a process back
+
+struct {
+  struct spinlock lock;
+  uint64 total;        // microseconds stalled since boot
+  uint64 window;       // microseconds stalled in this window
+  uint64 window_start; // time CSR at start of this window
+  int nstalled;        // processes stalled right now
+  uint64 some_start;   // time CSR when the first of them stalled
+  uint ticks;          // clock ticks into this window
+  int pressure;        // per mille stalled in the last window
+  uint faults;         // page faults in this window
+  uint fault_rate;     // page faults in the last window
+  int suspended;       // processes swapped out by load control
+  int resume;          // of those, how many may come back
+  int thrashing;       // load control should pick a process
+} psi;
+
+// add the time since psi.some_start, for which some process
+// has been stalled, to the system figures.
+// psi.lock must be held.
+static void
+charge_some(uint64 now)
+{
+  uint64 us = (now - psi.some_start) / TIMEBASE_US;
+
+  psi.total += us;
+  psi.window += us;
+  psi.some_start = now;
+}
+
+void
+stall_begin(void)
+{
+  struct proc *p = myproc();
+
+  p->stall_start = r_time();
+
+  acquire(&psi.lock);
+  if(psi.nstalled++ == 0)
+    psi.some_start = p->stall_start;
+  release(&psi.lock);
+}
+
+void
+stall_end(void)
+{
+  struct proc *p = myproc();
+  uint64 now = r_time();
+
+  p->stall += (now - p->stall_start) / TIMEBASE_US;
+
+  acquire(&psi.lock);
+  if(--psi.nstalled == 0)
+    charge_some(now);
+  release(&psi.lock);
+}
+
+void
+pressure_fault(void)
+{
+  acquire(&psi.lock);
+  psi.faults++;
+  release(&psi.lock);
+}
+
+// Close the window every PSI_WINDOW ticks.
+// Called by clockintr().
+void
+pressure_tick(void)
+{
+  uint64 now, len;
+
+  acquire(&psi.lock);
+  if(++psi.ticks >= PSI_WINDOW){
+    now = r_time();
+    if(psi.nstalled > 0)
+      charge_some(now);
+    len = (now - psi.window_start) / TIMEBASE_US;
+    if(len > 0)
+      psi.pressure = (psi.window * 1000) / len;
+    psi.window = 0;
+    psi.window_start = now;
+    psi.ticks = 0;
+    psi.fault_rate = psi.faults;
+    psi.faults = 0;
+    if(psi.fault_rate >= LOADCTL_HIGH){
+      psi.thrashing = 1;
+      wakeup(&psi.thrashing);
+    } else if(psi.fault_rate < LOADCTL_LOW && psi.suspended > psi.resume){
+      psi.resume++;
+      wakeup(&psi.suspended);
+    }
+    wakeup(&psi);
+  }
+  release(&psi.lock);
+}
+
+// Kernel thread that runs load control when pressure_tick()
+// finds the system thrashing. Picking the process takes every
+// p->lock, which the clock interrupt must not do.
+void
+loadctld(void *arg)
+{
+  acquire(&psi.lock);
+  while(!kthread_should_stop()){
+    if(psi.thrashing){
+      psi.thrashing = 0;
+      release(&psi.lock);
+      loadctl_pick();
+      acquire(&psi.lock);
+      continue;
+    }
+    sleep(&psi.thrashing, &psi.lock);
+  }
+  release(&psi.lock);
+}
+
+// Called by a process load control picked, on its way back to
+// user space: give up its frames and sleep until it is let go.
+void
+loadctl_wait(void)
+{
+  struct proc *p = myproc();
+
+  vm_lock(p);
+  swap_out_all(p);
+  vm_unlock(p);
+  p->suspend = 2;
+
+  acquire(&psi.lock);
+  psi.suspended++;
+  while(psi.resume == 0 && !p->killed)
+    sleep(&psi.suspended, &psi.lock);
+  if(!p->killed)
+    psi.resume--;
+  psi.suspended--;
+  release(&psi.lock);
+
+  p->suspend = 0;
+}
+
+// Block until the system pressure reaches threshold per mille.
+// Returns the pressure, or -1 if killed while waiting.
+int
+pressure_wait(int threshold)
+{
+  int pressure;
+
+  acquire(&psi.lock);
+  while(psi.pressure < threshold){
+    if(myproc()->killed){
+      release(&psi.lock);
+      return -1;
+    }
+    sleep(&psi, &psi.lock);
+  }
+  pressure = psi.pressure;
+  release(&psi.lock);
+  return pressure;
+}
+
+static char*
+putnum(char *s, uint64 n)
+{
+  char buf[20];
+  int i = 0;
+
+  do {
+    buf[i++] = '0' + n % 10;
+    n /= 10;
+  } while(n != 0);
+  while(--i >= 0)
+    *s++ = buf[i];
+  return s;
+}
+
+static char*
+putstr(char *s, char *t)
+{
+  while(*t)
+    *s++ = *t++;
+  return s;
+}
+
+// Read the pressure figures as text:
+//   some avg=<per mille> total=<us>
+//   self total=<us> ptpages=<pages> faults=<n> writes=<pages> group=<id> [policy=<POLICY_*>]
+//   faults rate=<per window> suspended=<processes>
+// where self is the reading process; its page-table pages, swap
+// writes, memory group and, under ADAPT, replacement policy are
+// those of the address space it runs in.
+int
+pressureread(int user_dst, uint64 dst, uint off, int n)
+{
+  char buf[256], *s = buf;
+  int pressure, suspended;
+  uint64 total;
+  uint fault_rate;
+
+  acquire(&psi.lock);
+  pressure = psi.pressure;
+  total = psi.total;
+  fault_rate = psi.fault_rate;
+  suspended = psi.suspended;
+  release(&psi.lock);
+
+  s = putstr(s, "some avg=");
+  s = putnum(s, pressure);
+  s = putstr(s, " total=");
+  s = putnum(s, total);
+  s = putstr(s, "\nself total=");
+  s = putnum(s, myproc()->stall);
+  s = putstr(s, " ptpages=");
+  s = putnum(s, mmproc()->ptpages);
+  s = putstr(s, " faults=");
+  s = putnum(s, myproc()->faults);
+  s = putstr(s, " writes=");
+  s = putnum(s, mmproc()->swap_writes);
+  s = putstr(s, " group=");
+  s = putnum(s, mg_id(mmproc()));
+#ifdef ADAPT
+  s = putstr(s, " policy=");
+  s = putnum(s, mmproc()->adapt.policy);
+#endif
+  s = putstr(s, "\nfaults rate=");
+  s = putnum(s, fault_rate);
+  s = putstr(s, " suspended=");
+  s = putnum(s, suspended);
+  s = putstr(s, "\n");
+
+  if(off >= s - buf)
+    return 0;
+  if(n > s - buf - off)
+    n = s - buf - off;
+  if(either_copyout(user_dst, dst, buf + off, n) < 0)
+    return -1;
+  return n;
+}
+
+void
+pressureinit(void)
+{
+  initlock(&psi.lock, "psi");
+  psi.window_start = r_time();
+  devsw[PRESSURE].readat = pressureread;
+}
@@ -5,19 +5,105 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "mman.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// Every proc ever allocated. procs are made on demand, a
+// page each, up to NPROC of them, and are never freed: an
+// exited one goes on the free list to be reused, so a pointer
+// to a proc stays valid. its kernel stack only exists while it
+// is in use.
+struct {
+  struct spinlock lock;
+  struct proc *head;           // all procs, newest first
+  struct proc *free;           // UNUSED procs
+  int n;                       // procs made so far
+} allproc;
 
 struct proc *initproc;
 
+// Per-CPU run queues of RUNNABLE processes. Each is a
+// min-heap on vruntime, the time a process has run scaled
+// down by its weight, so the process that has had the least
+// of its fair share runs next. A process goes on the queue
+// of the CPU that made it runnable and comes off it when
+// picked to run, so each CPU mostly touches its own queue;
+// an idle CPU steals from the longest one.
+// Each heap holds RUNQ_MAX processes; a full queue spills over
+// into another, and all of them together hold NPROC.
+#define RUNQ_MAX (NPROC / NCPU)
+struct runq {
+  struct spinlock lock;
+  struct proc *heap[RUNQ_MAX];
+  int n;                       // read without the lock as a hint
+  uint64 min_vruntime;         // never decreases
+} runq[NCPU];
+
+// harts waiting for work in idle(), which runq_push()
+// kicks when it queues some.
+static uint idle_harts;
+
+#define NICE_0_WEIGHT 1024
+#define SLEEPER_CREDIT (TIMEBASE / HZ) // time CSR cycles, one clock tick
+
+// weight of each nice level, -20 to 19: each level gets
+// about 1.25 times the CPU of the next one.
+static const int nice_weight[40] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+  9548, 7620, 6100, 4904, 3906,
+  3121, 2501, 1991, 1586, 1277,
+  1024, 820, 655, 526, 423,
+  335, 272, 215, 172, 137,
+  110, 87, 70, 56, 45,
+  36, 29, 23, 18, 15,
+};
+
+// Frames the processes running on all CPUs are expected to
+// fault in during their quanta. A process whose working set is
+// out in the swapfile isn't started next to others while the
+// total wouldn't fit in free memory: they would only evict each
+// other, since their footprints don't fit together.
+struct {
+  struct spinlock lock;
+  int demand;
+} memsched;
+
+// Sleeping processes, hashed by channel into wait queues, so
+// that wakeup() only looks at the sleepers on its channel and
+// the few sharing its queue. a sleeper is on the queue from
+// before it releases its condition lock in sleep() until it is
+// woken, so no wakeup is lost.
+#define NWAITQ 64
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+} waitq[NWAITQ];
+
 int nextpid = 1;
+int nextkpid = -1; // kernel threads count down from -1
 struct spinlock pid_lock;
 
+// Live processes by pid, so kill() finds one without
+// scanning every proc. a process is in it from allocproc()
+// until freeproc().
+#define NPIDHASH 256
+struct {
+  struct spinlock lock;
+  struct proc *chain[NPIDHASH];
+} pidhash;
+
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void kthread_start(void);
+static void runq_push(struct proc *p);
 void update_age(void);
+void record_wset(void);
+static int install_swapped(struct proc *p, uint64 va, pte_t *pte, char *page,
+                           int ram_arr_index, int swap_arr_index);
+void clear_referenced(void);
+void arc_admit(struct proc *p, struct page_data *page_data, uint64 va);
 
 extern char trampoline[]; // trampoline.S
 
@@ -27,32 +113,25 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void proc_mapstacks(pagetable_t kpgtbl) {
-  struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-  }
-}
+// guards p->vmlocked, the sleep lock vm_lock() takes on an
+// address space shared by a process and its threads.
+struct spinlock vmlock_lk;
 
 // initialize the proc table at boot time.
 void procinit(void)
 {
-  struct proc *p;
-  
+  if(sizeof(struct proc) > PGSIZE)
+    panic("procinit: struct proc");
+  initlock(&allproc.lock, "allproc");
   initlock(&pid_lock, "nextpid");
+  initlock(&pidhash.lock, "pidhash");
   initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->kstack = KSTACK((int) (p - proc));
-  }
+  initlock(&vmlock_lk, "vmlock");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  initlock(&memsched.lock, "memsched");
+  for(int i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
 }
 
 // Must be called with interrupts disabled,
@@ -81,6 +160,40 @@ struct proc* myproc(void) {
   return p;
 }
 
+// Return the process whose address space the current one
+// runs in, or zero if none. Differs from myproc() only in
+// threads made by clone().
+struct proc* mmproc(void) {
+  struct proc *p = myproc();
+
+  return p ? p->mm : 0;
+}
+
+// Lock the address space of mm against the other threads in
+// it, for a page fault or any other change to its page table,
+// p->ram and p->swap. May sleep.
+void vm_lock(struct proc *mm)
+{
+  acquire(&vmlock_lk);
+  while(mm->vmlocked)
+    sleep(&mm->vmlocked, &vmlock_lk);
+  mm->vmlocked = 1;
+  release(&vmlock_lk);
+}
+
+void vm_unlock(struct proc *mm)
+{
+  acquire(&vmlock_lk);
+  mm->vmlocked = 0;
+  wakeup(&mm->vmlocked);
+  release(&vmlock_lk);
+}
+
+// Does p share its address space with threads?
+static int shared(struct proc *p) {
+  return p->mm != p || p->nthreads > 0;
+}
+
 int allocpid() {
   int pid;
   
@@ -92,35 +205,94 @@ int allocpid() {
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
+// kernel threads get pids of their own, below zero, so the
+// numbering of user processes (and with it the pid > 2 test
+// for paging) is the same whether they run or not.
+static int allockpid(void) {
+  int pid;
+
+  acquire(&pid_lock);
+  pid = nextkpid--;
+  release(&pid_lock);
+
+  return pid;
+}
+
+static void pidhash_add(struct proc *p)
+{
+  struct proc **chain = &pidhash.chain[p->pid % NPIDHASH];
+
+  acquire(&pidhash.lock);
+  p->pid_next = *chain;
+  *chain = p;
+  release(&pidhash.lock);
+}
+
+static void pidhash_remove(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&pidhash.lock);
+  for(pp = &pidhash.chain[p->pid % NPIDHASH]; *pp != 0; pp = &(*pp)->pid_next){
+    if(*pp == p){
+      *pp = p->pid_next;
+      break;
+    }
+  }
+  release(&pidhash.lock);
+}
+
+// Take an UNUSED proc off the free list, or make a new one.
 // If found, initialize state required to run in the kernel,
-// and return with p->lock held.
+// plus, if user is set, a trapframe and an empty user page
+// table, and return with p->lock held.
 // If there are no free procs, or a memory allocation fails, return 0.
-static struct proc* allocproc(void) {
+static struct proc* allocproc(int user) {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    }
-    else {
-      release(&p->lock);
-    }
+  acquire(&allproc.lock);
+  if((p = allproc.free) != 0){
+    allproc.free = p->free_next;
+  } else if(allproc.n < NPROC && (p = (struct proc*)kalloc()) != 0){
+    memset(p, 0, sizeof(*p));
+    initlock(&p->lock, "proc");
+    p->slot = allproc.n++;
+    p->all_next = allproc.head;
+    // readers walk the list without the lock
+    __sync_synchronize();
+    allproc.head = p;
   }
-  return 0;
+  release(&allproc.lock);
+  if(p == 0)
+    return 0;
 
-found:
-  p->pid = allocpid();
+  acquire(&p->lock);
   p->state = USED;
+  p->mm = p;
+  if(user){
+    p->pid = allocpid();
+    pidhash_add(p);
+  } else {
+    p->pid = allockpid(); // not in the hash: kill() cannot reach it
+  }
 
-  #ifndef NONE
-    if (p->pid > 2){
-      release(&p->lock);
-      createSwapFile(p);
-      acquire(&p->lock);
-    }
-  #endif
+  // A kernel stack, followed by an invalid guard page.
+  if(kvmmapstack(KSTACK(p->slot)) < 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+  p->kstack = KSTACK(p->slot);
+
+  // Set up new context to start executing at forkret,
+  // which returns to user space, or at kthread_start.
+  memset(&p->context, 0, sizeof(p->context));
+  p->context.ra = user ? (uint64)forkret : (uint64)kthread_start;
+  p->context.sp = p->kstack + PGSIZE;
+
+  // a kernel thread has no user memory
+  if(!user)
+    return p;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -136,13 +308,8 @@ found:
     release(&p->lock);
     return 0;
   }
+  p->ptpages = uvmptpages(p->pagetable, 2);
 
-  // Set up new context to start executing at forkret,
-  // which returns to user space.
-  memset(&p->context, 0, sizeof(p->context));
-  p->context.ra = (uint64)forkret;
-  p->context.sp = p->kstack + PGSIZE;
-  
   return p;
 }
 
@@ -151,10 +318,12 @@ found:
 // p->lock must be held.
 static void freeproc(struct proc *p)
 {
+  mg_exit(p);
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
+  // a thread's page table is the one it was clone()d into
+  if(p->pagetable && p->mm == p)
     proc_freepagetable(p->pagetable, p->sz);
 
   #ifndef NONE
@@ -165,17 +334,67 @@ static void freeproc(struct proc *p)
         }
     }
     p->fifo_counter = 0;
+    memset(p->advice, MADV_NORMAL, sizeof(p->advice));
+    p->nlocked = 0;
   #endif
 
+  // back to the zeroed state of a proc fresh from kalloc,
+  // which fork() and exec() start the policies from
+  p->fault_va = 0;
+  p->arc_target = 0;
+  memset(p->ghost, 0, sizeof(p->ghost));
+  memset(p->ghost_time, 0, sizeof(p->ghost_time));
+  p->min_seq = 0;
+  p->max_seq = 0;
+  memset(p->gens, 0, sizeof(p->gens));
+  p->mglru_filter = 0;
+
   p->pagetable = 0;
+  p->ptpages = 0;
+  p->swap_writes = 0;
+  p->faults = 0;
+  p->wset = 0;
+  p->wset_last = 0;
+  p->prepage = 0;
+  p->suspend = 0;
+  memset(&p->adapt, 0, sizeof(p->adapt));
   p->sz = 0;
+  p->stall = 0;
+  p->stall_start = 0;
+  p->nice = 0;
+  p->vruntime = 0;
+  p->run_start = 0;
+  p->mem_demand = 0;
+  p->slice = 0;
+  if(p->pid > 0)
+    pidhash_remove(p);
   p->pid = 0;
   p->parent = 0;
+  p->child = 0;
+  p->sibling = 0;
   p->name[0] = 0;
+  p->kfn = 0;
+  p->karg = 0;
+  p->mm = 0;
+  p->tslot = 0;
+  p->nthreads = 0;
+  p->tslots = 0;
+  p->ncopy = 0;
+  p->vmlocked = 0;
+  p->pid_next = 0;
+  p->wq_next = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
   p->state = UNUSED;
+
+  if(p->kstack)
+    kvmunmapstack(p->kstack);
+  p->kstack = 0;
+  acquire(&allproc.lock);
+  p->free_next = allproc.free;
+  allproc.free = p;
+  release(&allproc.lock);
 }
 
 // Create a user page table for a given process,
@@ -236,13 +455,15 @@ void userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(1);
   initproc = p;
+  mg_fork(p, p); // into the root group
   
   // allocate one user page and copy init's instructions
   // and data into it.
   uvminit(p->pagetable, initcode, sizeof(initcode));
   p->sz = PGSIZE;
+  p->ptpages = uvmptpages(p->pagetable, 2);
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;      // user program counter
@@ -252,12 +473,14 @@ void userinit(void)
   p->cwd = namei("/");
 
   p->state = RUNNABLE;
+  runq_push(p);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
+// The caller must hold vm_lock() on its address space.
 int growproc(int n)
 {
   #ifdef NONE
@@ -265,7 +488,7 @@ int growproc(int n)
   #endif
 
   uint sz;
-  struct proc *p = myproc();
+  struct proc *p = mmproc();
 
   sz = p->sz;
   if(n > 0){
@@ -283,7 +506,7 @@ int growproc(int n)
 int lazy_growproc(int n)
 {
   uint sz;
-  struct proc *p = myproc();
+  struct proc *p = mmproc();
   
   sz = p->sz;
   if(n > 0){
@@ -298,6 +521,54 @@ int lazy_growproc(int n)
   return 0;
 }
 
+#ifndef NONE
+// give np a copy of p's swapfile and paging state.
+// returns 0 on success, -1 if out of memory.
+static int copyswap(struct proc *np, struct proc *p)
+{
+  struct page_data *page_data;
+  char *page;
+
+  if((page = kalloc()) == 0)
+    return -1;
+  for(page_data = p->swap; page_data < &p->swap[MAX_PSYC_PAGES]; page_data++){
+    if(!page_data->used)
+      continue;
+    if(readFromSwapFile(p, page, page_data->offset, PGSIZE) == -1 ||
+       extendSwapFile(np, page_data->offset) == -1 ||
+       writeToSwapFile(np, page, page_data->offset, PGSIZE) == -1){
+      kfree(page);
+      return -1;
+    }
+  }
+  kfree(page);
+
+  memmove(np->ram, p->ram, 16 * sizeof(struct page_data));
+  memmove(np->swap, p->swap, 16 * sizeof(struct page_data));
+  memmove(np->advice, p->advice, sizeof(p->advice));
+  memmove(np->ghost, p->ghost, sizeof(p->ghost));
+  memmove(np->ghost_time, p->ghost_time, sizeof(p->ghost_time));
+  np->arc_target = p->arc_target;
+  np->min_seq = p->min_seq;
+  np->max_seq = p->max_seq;
+  memmove(np->gens, p->gens, sizeof(p->gens));
+  np->mglru_filter = p->mglru_filter;
+  np->adapt.policy = p->adapt.policy;
+
+  // memory locks are not inherited, nor are the clean
+  // copies of resident pages, which were not copied
+  for (int i = 0; i < MAX_PSYC_PAGES; i++){
+    np->ram[i].locked = 0;
+    np->ram[i].offset = -1;
+  }
+  np->nlocked = 0;
+  mg_sync(np);
+
+  np->fifo_counter = p->fifo_counter;
+  return 0;
+}
+#endif
+
 // Create a new process, copying the parent.
 // Sets up child kernel stack to return as if from fork() system call.
 int fork(void)
@@ -305,19 +576,35 @@ int fork(void)
   int i, pid;
   struct proc *np;
   struct proc *p = myproc();
+  struct proc *mm = p->mm;
+
+  // keep the other threads from changing what is copied
+  vm_lock(mm);
 
   // Allocate process.
-  if((np = allocproc()) == 0){
+  if((np = allocproc(1)) == 0){
+    vm_unlock(mm);
     return -1;
   }
+  mg_fork(np, mm);
+
+  #ifndef NONE
+    if (np->pid > 2){
+      release(&np->lock);
+      createSwapFile(np);
+      acquire(&np->lock);
+    }
+  #endif
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  if(uvmcopy(mm->pagetable, np->pagetable, mm->sz) < 0){
     freeproc(np);
     release(&np->lock);
+    vm_unlock(mm);
     return -1;
   }
-  np->sz = p->sz;
+  np->sz = mm->sz;
+  np->ptpages = uvmptpages(np->pagetable, 2);
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -332,42 +619,166 @@ int fork(void)
   np->cwd = idup(p->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
+  np->nice = p->nice;
+  np->vruntime = p->vruntime;
 
   pid = np->pid;
 
   release(&np->lock);
 
   #ifndef NONE
-    if (p->pid > 2){
-      uint size = count_pages(p->swap, 0);
-
-      for (int i = 0; i < size; i++) {
-        char *page = kalloc();
-        
-        if ((readFromSwapFile(p, page, i * PGSIZE, PGSIZE)) == -1)
-        panic ("failed to read from swapfile");
-        if ((writeToSwapFile(np, page, i * PGSIZE, PGSIZE)) == -1)
-          panic("failed to write to swapfile");
-        
-        kfree(page);
-      }
-
-      memmove(np->ram, p->ram, 16 * sizeof(struct page_data));
-      memmove(np->swap, p->swap, 16 * sizeof(struct page_data));
-
-      np->fifo_counter = p->fifo_counter;
+    if (mm->pid > 2 && copyswap(np, mm) < 0){
+      // undo what exit() would: the files and the swapfile
+      for(i = 0; i < NOFILE; i++)
+        if(np->ofile[i])
+          fileclose(np->ofile[i]);
+      begin_op();
+      iput(np->cwd);
+      end_op();
+      removeSwapFile(np);
+      acquire(&np->lock);
+      freeproc(np);
+      release(&np->lock);
+      vm_unlock(mm);
+      return -1;
     }
   #endif
+  vm_unlock(mm);
+
+  acquire(&wait_lock);
+  np->parent = p;
+  np->sibling = p->child;
+  p->child = np;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  runq_push(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a thread in the caller's address space: a process
+// with its own trapframe, user stack and copies of the open
+// files, but the caller's page table, p->ram, p->swap and
+// swapfile. It starts at fn(arg) with sp at stack, and must
+// call exit() rather than return. Like a forked child it is
+// reaped with wait(). Returns its pid, or -1.
+int clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int i, pid, slot;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct proc *mm = p->mm;
+
+  if(stack % 16 != 0 || stack == 0 || stack > mm->sz)
+    return -1;
+
+  // Allocate process.
+  if((np = allocproc(1)) == 0)
+    return -1;
+
+  // it runs in mm's page table, not the one allocproc() made
+  proc_freepagetable(np->pagetable, 0);
+  np->pagetable = mm->pagetable;
+  np->ptpages = 0;
+  np->mm = mm;
+  // it is charged nothing: its pages are mm's
+  mg_fork(np, mm);
+  release(&np->lock);
+
+  // a slot for its trapframe under mm's
+  acquire(&wait_lock);
+  for(slot = 1; slot < NTHREAD; slot++)
+    if((mm->tslots & (1 << slot)) == 0)
+      break;
+  if(slot < NTHREAD)
+    mm->tslots |= 1 << slot;
+  release(&wait_lock);
+  if(slot == NTHREAD)
+    goto bad;
+  np->tslot = slot;
+
+  vm_lock(mm);
+  if(mappages(mm->pagetable, TFRAME(slot), PGSIZE,
+              (uint64)(np->trapframe), PTE_R | PTE_W) < 0){
+    vm_unlock(mm);
+    acquire(&wait_lock);
+    mm->tslots &= ~(1 << slot);
+    release(&wait_lock);
+    goto bad;
+  }
+  vm_unlock(mm);
+
+  // start at fn(arg) on the new stack.
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+
+  // increment reference counts on open file descriptors.
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = idup(p->cwd);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+  np->nice = p->nice;
+  np->vruntime = p->vruntime;
+
+  pid = np->pid;
 
   acquire(&wait_lock);
   np->parent = p;
+  np->sibling = p->child;
+  p->child = np;
+  mm->nthreads++;
   release(&wait_lock);
 
   acquire(&np->lock);
   np->state = RUNNABLE;
+  runq_push(np);
   release(&np->lock);
 
   return pid;
+
+bad:
+  acquire(&np->lock);
+  freeproc(np);
+  release(&np->lock);
+  return -1;
+}
+
+// p is exiting: kill the threads in its address space and
+// wait until they have left it. A thread clone()d while this
+// runs is caught when its creator leaves.
+static void stop_threads(struct proc *p)
+{
+  struct proc *t;
+
+  acquire(&wait_lock);
+  while(p->nthreads > 0){
+    release(&wait_lock);
+    for(t = allproc.head; t != 0; t = t->all_next){
+      if(t == p || t->mm != p)
+        continue;
+      acquire(&t->lock);
+      if(t->mm == p && t->state != ZOMBIE){
+        t->killed = 1;
+        if(t->state == SLEEPING){
+          // Wake thread from sleep().
+          t->state = RUNNABLE;
+          runq_push(t);
+        }
+      }
+      release(&t->lock);
+    }
+    acquire(&wait_lock);
+    if(p->nthreads > 0)
+      sleep(&p->nthreads, &wait_lock);
+  }
+  release(&wait_lock);
 }
 
 // Pass p's abandoned children to init.
@@ -376,12 +787,15 @@ void reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+  if(p->child == 0)
+    return;
+  while((pp = p->child) != 0){
+    p->child = pp->sibling;
+    pp->parent = initproc;
+    pp->sibling = initproc->child;
+    initproc->child = pp;
   }
+  wakeup(initproc);
 }
 
 // Exit the current process.  Does not return.
@@ -394,8 +808,17 @@ void exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  if(p->mm != p){
+    // leave the address space, which isn't ours to free
+    vm_lock(p->mm);
+    uvmunmap(p->pagetable, TFRAME(p->tslot), 1, 0);
+    vm_unlock(p->mm);
+  } else {
+    stop_threads(p);
+  }
+
   #ifndef NONE
-    if (p->pid > 2){
+    if (p->pid > 2 && p->mm == p){
       if (removeSwapFile(p) != 0)
         panic("failed to remove swapfile");
     }
@@ -417,6 +840,15 @@ void exit(int status)
 
   acquire(&wait_lock);
 
+  if(p->mm != p){
+    p->mm->tslots &= ~(1 << p->tslot);
+    if(--p->mm->nthreads == 0)
+      wakeup(&p->mm->nthreads);
+    // the address space may go as soon as wait_lock is released
+    p->pagetable = 0;
+    p->mm = 0;
+  }
+
   // Give any children to init.
   reparent(p);
 
@@ -439,41 +871,38 @@ void exit(int status)
 // Return -1 if this process has no children.
 int wait(uint64 addr)
 {
-  struct proc *np;
-  int havekids, pid;
+  struct proc *np, **npp;
+  int pid;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      if(np->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
-
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(np);
+    // Scan through the children looking for exited ones.
+    for(npp = &p->child; (np = *npp) != 0; npp = &np->sibling){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&np->lock);
+
+      if(np->state == ZOMBIE){
+        // Found one.
+        pid = np->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                                sizeof(np->xstate)) < 0) {
           release(&np->lock);
           release(&wait_lock);
-          return pid;
+          return -1;
         }
+        *npp = np->sibling;
+        freeproc(np);
         release(&np->lock);
+        release(&wait_lock);
+        return pid;
       }
+      release(&np->lock);
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || p->killed){
+    if(p->child == 0 || p->killed){
       release(&wait_lock);
       return -1;
     }
@@ -483,10 +912,324 @@ int wait(uint64 addr)
   }
 }
 
+// Kernel threads.
+//
+// A kernel thread is a proc without user memory, files or a
+// swapfile that runs fn(arg) in the kernel and never goes to
+// user space. It is scheduled and sleeps like any process, so
+// background work such as pre-zeroing pages runs in its own
+// context instead of riding on scheduler() or on syscalls.
+// It is nobody's child: kthread_stop() reaps it.
+
+// Start a kernel thread running fn(arg).
+// Returns it, or 0 if there is no free proc.
+struct proc* kthread_create(void (*fn)(void*), void *arg, char *name)
+{
+  struct proc *p;
+
+  if((p = allocproc(0)) == 0)
+    return 0;
+  p->kfn = fn;
+  p->karg = arg;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  p->state = RUNNABLE;
+  runq_push(p);
+
+  release(&p->lock);
+  return p;
+}
+
+// fn() returned: stay a zombie until kthread_stop().
+static void kthread_exit(void)
+{
+  struct proc *p = myproc();
+
+  acquire(&wait_lock);
+
+  // kthread_stop() might be sleeping on p.
+  wakeup(p);
+
+  acquire(&p->lock);
+  p->state = ZOMBIE;
+
+  release(&wait_lock);
+
+  // Jump into the scheduler, never to return.
+  sched();
+  panic("zombie kthread exit");
+}
+
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to here.
+static void kthread_start(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfn(p->karg);
+  kthread_exit();
+}
+
+// Should the calling kernel thread return from fn()?
+// Its sleeps return early once this is set.
+int kthread_should_stop(void)
+{
+  return myproc()->killed;
+}
+
+// Ask kernel thread p to stop, wait until its fn() has
+// returned, and free it.
+void kthread_stop(struct proc *p)
+{
+  acquire(&wait_lock);
+  acquire(&p->lock);
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake it from sleep().
+    p->state = RUNNABLE;
+    runq_push(p);
+  }
+  while(p->state != ZOMBIE){
+    release(&p->lock);
+    sleep(p, &wait_lock);
+    acquire(&p->lock);
+  }
+  freeproc(p);
+  release(&p->lock);
+  release(&wait_lock);
+}
+
+// Put p, just made RUNNABLE, on this CPU's run queue, or
+// another one if that is full. A process that slept for
+// long gets no more than SLEEPER_CREDIT ahead of the rest.
+// p->lock must be held.
+static void runq_push(struct proc *p)
+{
+  struct runq *rq = &runq[cpuid()];
+  int i;
+
+  acquire(&rq->lock);
+  // full: another one has room, as there are no more
+  // than NPROC processes
+  for(i = 0; rq->n == RUNQ_MAX; i = (i + 1) % NCPU){
+    release(&rq->lock);
+    rq = &runq[i];
+    acquire(&rq->lock);
+  }
+  if(p->vruntime + SLEEPER_CREDIT < rq->min_vruntime)
+    p->vruntime = rq->min_vruntime - SLEEPER_CREDIT;
+  for(i = rq->n++; i > 0 && rq->heap[(i-1)/2]->vruntime > p->vruntime; i = (i-1)/2)
+    rq->heap[i] = rq->heap[(i-1)/2];
+  rq->heap[i] = p;
+  release(&rq->lock);
+
+  // wake an idle hart to steal it
+  uint idle = idle_harts & ~(1 << cpuid());
+  if(idle){
+    int hart = 0;
+    while((idle & (1 << hart)) == 0)
+      hart++;
+    if(__sync_fetch_and_and(&idle_harts, ~(1 << hart)) & (1 << hart))
+      kick(hart);
+  }
+}
+
+// Take the process with the least vruntime off rq, or 0 if
+// it is empty. its vruntime is made relative to to's.
+static struct proc* runq_pop(struct runq *rq, struct runq *to)
+{
+  struct proc *p, *last;
+  int i, c;
+
+  acquire(&rq->lock);
+  if(rq->n == 0){
+    release(&rq->lock);
+    return 0;
+  }
+  p = rq->heap[0];
+  last = rq->heap[--rq->n];
+  for(i = 0; (c = 2*i + 1) < rq->n; i = c){
+    if(c + 1 < rq->n && rq->heap[c+1]->vruntime < rq->heap[c]->vruntime)
+      c++;
+    if(last->vruntime <= rq->heap[c]->vruntime)
+      break;
+    rq->heap[i] = rq->heap[c];
+  }
+  rq->heap[i] = last;
+  if(p->vruntime > rq->min_vruntime)
+    rq->min_vruntime = p->vruntime;
+  if(rq != to){
+    if(p->vruntime + to->min_vruntime > rq->min_vruntime)
+      p->vruntime = p->vruntime + to->min_vruntime - rq->min_vruntime;
+    else
+      p->vruntime = 0;
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Next process for this CPU: from its own queue, or else
+// stolen from the longest queue of another CPU.
+static struct proc* runq_next(void)
+{
+  int id = cpuid(), busiest = -1;
+  struct proc *p;
+
+  if((p = runq_pop(&runq[id], &runq[id])) != 0)
+    return p;
+  for(int i = 0; i < NCPU; i++)
+    if(i != id && runq[i].n > 0 && (busiest < 0 || runq[i].n > runq[busiest].n))
+      busiest = i;
+  return busiest < 0 ? 0 : runq_pop(&runq[busiest], &runq[id]);
+}
+
+#define QUANTUM_REFAULT 2 // ticks for a process that faults its working set in
+
+// pages of p's working set that are out in the swapfile,
+// which it has to fault back in when it runs.
+static int wset_demand(struct proc *p)
+{
+  int n = 0;
+
+  #ifndef NONE
+    if(p->pid > 2)
+      for(int i = 0; i < MAX_PSYC_PAGES; i++)
+        if(p->swap[i].used && p->swap[i].va / PGSIZE < MAX_TOTAL_PAGES &&
+           (p->wset & (1 << (p->swap[i].va / PGSIZE))))
+          n++;
+  #endif
+  return n;
+}
+
+// reserve the frames p will fault in, if they fit next to what
+// the other CPUs reserved or nothing else is. on success, sets
+// its quantum: a longer one when it pays to bring its working
+// set back. p->lock must be held. returns 1 if p may run.
+static int mem_admit(struct proc *p)
+{
+  int d = wset_demand(p), ok;
+
+  acquire(&memsched.lock);
+  ok = d == 0 || memsched.demand == 0 || memsched.demand + d <= kfreepages();
+  if(ok)
+    memsched.demand += d;
+  release(&memsched.lock);
+  if(ok){
+    p->mem_demand = d;
+    p->slice = d > 0 ? QUANTUM_REFAULT : 1;
+  }
+  return ok;
+}
+
+// p is off the CPU: give back what mem_admit() reserved.
+static void mem_release(struct proc *p)
+{
+  acquire(&memsched.lock);
+  memsched.demand -= p->mem_demand;
+  release(&memsched.lock);
+  p->mem_demand = 0;
+}
+
+// The next process to run, returned with p->lock held, or 0.
+// when the first one's working set doesn't fit next to the
+// running ones, the one after it goes first.
+static struct proc* pick(void)
+{
+  struct proc *p, *q;
+
+  if((p = runq_next()) == 0)
+    return 0;
+  acquire(&p->lock);
+  if(mem_admit(p))
+    return p;
+
+  // take the next one before p goes back, or p is it again
+  q = runq_next();
+  runq_push(p);
+  release(&p->lock);
+  if(q == 0)
+    return 0;
+  acquire(&q->lock);
+  if(mem_admit(q))
+    return q;
+  runq_push(q);
+  release(&q->lock);
+  return 0;
+}
+
+// Charge p for the time since it was switched to.
+// p->lock must be held.
+static void account(struct proc *p)
+{
+  uint64 delta = r_time() - p->run_start;
+
+  p->vruntime += delta * NICE_0_WEIGHT / nice_weight[p->nice + 20];
+}
+
+// Add inc to the nice level of the caller, keeping it
+// within -20 to 19. Returns the new level.
+int nice(int inc)
+{
+  struct proc *p = myproc();
+
+  // no step can be wider than the range, and a clamped
+  // one can't overflow
+  if(inc < -40)
+    inc = -40;
+  if(inc > 40)
+    inc = 40;
+  acquire(&p->lock);
+  p->nice += inc;
+  if(p->nice < -20)
+    p->nice = -20;
+  if(p->nice > 19)
+    p->nice = 19;
+  inc = p->nice;
+  release(&p->lock);
+  return inc;
+}
+
+// is any process waiting on a run queue?
+static int runq_waiting(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    if(runq[i].n > 0)
+      return 1;
+  return 0;
+}
+
+// Nothing to run: wait in wfi for an interrupt. Harts other
+// than 0, which keeps time, stop their clock ticks meanwhile,
+// so an idle hart takes no interrupts until a device or a
+// kick from runq_push() wakes it.
+static void idle(void)
+{
+  int id;
+
+  intr_off();
+  id = cpuid();
+  // advertise before the last look, so that work queued
+  // after it kicks this hart
+  __sync_fetch_and_or(&idle_harts, 1 << id);
+  if(!runq_waiting()){
+    if(id != 0)
+      tick_stop();
+    // wfi returns once an interrupt is pending, even with
+    // interrupts off, so a kick since the look isn't lost
+    asm volatile("wfi");
+  }
+  __sync_fetch_and_and(&idle_harts, ~(1 << id));
+  intr_on();
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - choose a process to run, off this CPU's run queue
+//    or, if it is empty, off another CPU's.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -500,32 +1243,61 @@ void scheduler(void)
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-        #ifdef NFUA
-          if (p->pid > 2) {
-            update_age();
-          }
-        #endif
-
-        #ifdef LAPA
-          if (p->pid > 2) {
-            update_age();
-          }
-        #endif
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&p->lock);
+    if((p = pick()) == 0) {
+      idle();
+      continue;
     }
+    // p->lock is held, so interrupts are off
+    tick_start();
+    kvmsync();
+    if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      p->state = RUNNING;
+      c->proc = p;
+      p->run_start = r_time();
+      swtch(&c->context, &p->context);
+      account(p);
+      mem_release(p);
+      if(p->state == RUNNABLE)
+        runq_push(p);
+      // an address space shared with threads may be changing
+      // under a fault on another hart: leave its reference
+      // bits to the eviction path.
+      #ifndef NONE
+        if (p->pid > 2 && !shared(p) && p->state != ZOMBIE) {
+          record_wset();
+        }
+      #endif
+      #ifdef NFUA
+        if (p->pid > 2 && !shared(p)) {
+          update_age();
+        }
+      #endif
+
+      #ifdef LAPA
+        if (p->pid > 2 && !shared(p)) {
+          update_age();
+        }
+      #endif
+
+      #ifdef NRU
+        if (p->pid > 2 && !shared(p)) {
+          clear_referenced();
+        }
+      #endif
+
+      #ifdef ADAPT
+        if (p->pid > 2 && !shared(p)) {
+          update_age();
+        }
+      #endif
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      c->proc = 0;
+    }
+    release(&p->lock);
   }
 }
 
@@ -586,11 +1358,42 @@ void forkret(void)
   usertrapret();
 }
 
+static struct waitq* waitq_of(void *chan)
+{
+  return &waitq[((uint64)chan >> 4) % NWAITQ];
+}
+
+// Take p off the wait queue of chan, if it is still there.
+static void waitq_remove(struct proc *p, void *chan)
+{
+  struct waitq *wq = waitq_of(chan);
+  struct proc **pp;
+
+  acquire(&wq->lock);
+  for(pp = &wq->head; *pp != 0; pp = &(*pp)->wq_next){
+    if(*pp == p){
+      *pp = p->wq_next;
+      break;
+    }
+  }
+  release(&wq->lock);
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void sleep(void *chan, struct spinlock *lk) {
   struct proc *p = myproc();
+  struct waitq *wq = waitq_of(chan);
   
+  // Get on the wait queue while still holding lk, so
+  // that a wakeup() after lk is released finds p there.
+  // wakeup() takes the queue lock before p->lock, so
+  // p->lock can't be held here.
+  acquire(&wq->lock);
+  p->wq_next = wq->head;
+  wq->head = p;
+  release(&wq->lock);
+
   // Must acquire p->lock in order to
   // change p->state and then call sched.
   // Once we hold p->lock, we can be
@@ -612,6 +1415,8 @@ void sleep(void *chan, struct spinlock *lk) {
 
   // Reacquire original lock.
   release(&p->lock);
+  // woken by kill(), p may still be queued
+  waitq_remove(p, chan);
   acquire(lk);
 }
 
@@ -619,17 +1424,25 @@ void sleep(void *chan, struct spinlock *lk) {
 // Must be called without any p->lock.
 void wakeup(void *chan)
 {
-  struct proc *p;
+  struct waitq *wq = waitq_of(chan);
+  struct proc *p, **pp;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  acquire(&wq->lock);
+  for(pp = &wq->head; (p = *pp) != 0; ){
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
+        *pp = p->wq_next;
         p->state = RUNNABLE;
+        runq_push(p);
+        release(&p->lock);
+        continue;
       }
       release(&p->lock);
     }
+    pp = &p->wq_next;
   }
+  release(&wq->lock);
 }
 
 // Kill the process with the given pid.
@@ -639,20 +1452,106 @@ int kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
+  if(pid <= 0)
+    return -1;
+  acquire(&pidhash.lock);
+  for(p = pidhash.chain[pid % NPIDHASH]; p != 0; p = p->pid_next)
+    if(p->pid == pid)
+      break;
+  release(&pidhash.lock);
+  if(p == 0)
+    return -1;
+
+  acquire(&p->lock);
+  // it may have been freed and reused since
+  if(p->pid != pid){
+    release(&p->lock);
+    return -1;
+  }
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    p->state = RUNNABLE;
+    runq_push(p);
+  }
+  release(&p->lock);
+  return 0;
+}
+
+// the pages p holds, resident and swapped.
+static int footprint(struct proc *p)
+{
+  // a thread's pages are counted in the process it shares them with
+  if(p->mm != p)
+    return 0;
+  #ifndef NONE
+    if(p->pid > 2)
+      return count_pages(p->ram, 0) + count_pages(p->swap, 0);
+  #endif
+  return PGROUNDUP(p->sz) / PGSIZE;
+}
+
+// Out of memory: kill the live process with the largest
+// footprint so that its memory is given back when it exits.
+// init is never chosen. Returns the pid killed, or -1.
+int oom_kill(void)
+{
+  struct proc *p, *victim = 0;
+  int size, max = 0, pid;
+
+  for(p = allproc.head; p != 0; p = p->all_next){
     acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
+    if(p != initproc && p->state != UNUSED && p->state != ZOMBIE && !p->killed){
+      size = footprint(p);
+      if(size > max){
+        max = size;
+        victim = p;
       }
-      release(&p->lock);
-      return 0;
     }
     release(&p->lock);
   }
-  return -1;
+  if(victim == 0)
+    return -1;
+
+  pid = victim->pid;
+  if(kill(pid) < 0)
+    return -1;
+  printf("oom: killed pid %d (%s), %d pages\n", pid, victim->name, max);
+  return pid;
+}
+
+// Load control: the system is thrashing. Have the paging process
+// with the most resident pages swap itself out and wait, unless
+// it is the last one still running.
+void loadctl_pick(void)
+{
+  struct proc *p, *victim = 0;
+  int n = 0, size, max = 0;
+
+  #ifdef NONE
+    return; // nothing is ever swapped out
+  #endif
+
+  for(p = allproc.head; p != 0; p = p->all_next){
+    acquire(&p->lock);
+    if(p->pid > 2 && !shared(p) && p->suspend == 0 && !p->killed &&
+       (p->state == RUNNABLE || p->state == RUNNING || p->state == SLEEPING)){
+      n++;
+      size = count_pages(p->ram, 0);
+      if(size > max){
+        max = size;
+        victim = p;
+      }
+    }
+    release(&p->lock);
+  }
+  if(n < 2 || victim == 0)
+    return;
+
+  acquire(&victim->lock);
+  if(victim->suspend == 0)
+    victim->suspend = 1;
+  release(&victim->lock);
 }
 
 // Copy to either a user address, or kernel address,
@@ -701,7 +1600,7 @@ void procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(p = allproc.head; p != 0; p = p->all_next){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -709,12 +1608,17 @@ void procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    printf(" ptpages %d swapwrites %d faults %d nice %d",
+           p->ptpages, p->swap_writes, p->faults, p->nice);
     printf("\n");
   }
 }
 
+// read the swapped page at va into a new frame and record it
+// in p->ram[ram_arr_index]. returns the p->swap index it left
+// free, or -1 if out of memory, with nothing changed.
 int swapfile_to_ram(uint64 va, pte_t *pte, int ram_arr_index){
-  struct proc *p = myproc();
+  struct proc *p = mmproc();
 
   // find the index of va in p->swap
   int swap_arr_index = -1;
@@ -730,41 +1634,113 @@ int swapfile_to_ram(uint64 va, pte_t *pte, int ram_arr_index){
 
   // read the content from swapfile into ram
   char *page = kalloc();
-  int off = swap_arr_index * PGSIZE;
-  if ((readFromSwapFile(p, page, off, PGSIZE)) == -1)
-    panic ("error when reading from swap file");
+  if (page == 0)
+    return -1;
+  if ((readFromSwapFile(p, page, p->swap[swap_arr_index].offset, PGSIZE)) == -1 ||
+      install_swapped(p, va, pte, page, ram_arr_index, swap_arr_index) < 0){
+    kfree(page);
+    return -1;
+  }
 
-  // add page to p->ram
-  page_data = &p->ram[ram_arr_index];
+  // return the free index in swap_array
+  return swap_arr_index;
+}
 
-  #ifdef SCFIFO
-    page_data->fifo_time = p->fifo_counter++;
-  #endif
+// map page, read from p->swap[swap_arr_index], at va and move
+// the page from p->swap to p->ram[ram_arr_index].
+// returns 0, or -1 if out of memory, with nothing changed.
+static int install_swapped(struct proc *p, uint64 va, pte_t *pte, char *page,
+                           int ram_arr_index, int swap_arr_index){
+  // map virtual address and physical address
+  if(mappage(p->pagetable, va, (uint64)page, PTE_W | PTE_X | PTE_R | PTE_U) != 0)
+    return -1;
 
-  #ifdef NFUA
-    page_data->age = 0;
-  #endif
+  // add page to p->ram
+  init_page(p, &p->ram[ram_arr_index], va);
 
-  #ifdef LAPA
-    page_data->age = 0xFFFFFFFF;
+  #ifdef NRU
+    // the swapfile keeps a clean copy until the page is written
+    p->ram[ram_arr_index].offset = p->swap[swap_arr_index].offset;
   #endif
 
-  page_data->offset = -1;
-  page_data->va = va;
-  page_data->used = 1;
-  
-  // map virtual address and physical address
-  if(mappage(p->pagetable, va, (uint64)page, PTE_W | PTE_X | PTE_R | PTE_U) != 0){
-    kfree(page);
-    panic("mappage error");
-  }
+  #ifdef ADAPT
+    adapt_refault(p, va);
+  #endif
 
   // turn off PTE_PG bit and remove from p->swap
   *pte &= ~(PTE_PG);
   remove_page(&p->swap[swap_arr_index]);
+  return 0;
+}
 
-  // return the free index in swap_array
-  return swap_arr_index;
+// note the pages p used in the quantum that just ended. the
+// pages used in this quantum and the one before are its
+// working set, for prepage().
+void record_wset(){
+  struct page_data *page;
+  struct proc *p = myproc();
+  uint used = 0;
+
+  for(page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++){
+    if(page->used && page->va / PGSIZE < MAX_TOTAL_PAGES &&
+       (*walk(p->pagetable, page->va, 0) & PTE_A))
+      used |= 1 << (page->va / PGSIZE);
+  }
+  p->wset = used | p->wset_last;
+  p->wset_last = used;
+  p->prepage = 1;
+}
+
+// p is running again: read the swapped pages of its working set
+// back in one batch, in swapfile order, into the frames it can
+// take without evicting anything.
+void prepage(struct proc *p){
+  char *pages[MAX_PSYC_PAGES];
+  uint offs[MAX_PSYC_PAGES];
+  int idx[MAX_PSYC_PAGES];
+  int n = 0, room = 0;
+
+  p->prepage = 0;
+  if (p->pid <= 2 || !can_grow(p))
+    return;
+  for (int i = 0; i < MAX_PSYC_PAGES; i++)
+    room += !p->ram[i].used;
+
+  // the swapped working set, sorted by offset
+  for (int i = 0; i < MAX_PSYC_PAGES && n < room; i++){
+    struct page_data *s = &p->swap[i];
+    if (!s->used || s->va / PGSIZE >= MAX_TOTAL_PAGES || (p->wset & (1 << (s->va / PGSIZE))) == 0)
+      continue;
+    int j = n++;
+    for (; j > 0 && p->swap[idx[j-1]].offset > s->offset; j--)
+      idx[j] = idx[j-1];
+    idx[j] = i;
+  }
+
+  for (int i = 0; i < n; i++){
+    if ((pages[i] = kalloc()) == 0){
+      n = i;
+      break;
+    }
+    offs[i] = p->swap[idx[i]].offset;
+  }
+
+  if (n > 0 && readPagesFromSwapFile(p, pages, offs, n) == 0){
+    for (int i = 0; i < n; i++){
+      uint64 va = p->swap[idx[i]].va;
+      int ram_arr_index;
+      // a memory group limit may be reached part way
+      if (!can_grow(p) || (ram_arr_index = free_ram_index(p)) < 0 ||
+          install_swapped(p, va, walk(p->pagetable, va, 0), pages[i],
+                          ram_arr_index, idx[i]) < 0)
+        break;
+      pages[i] = 0;
+      mg_sync(p);
+    }
+  }
+  for (int i = 0; i < n; i++)
+    if (pages[i])
+      kfree(pages[i]);
 }
 
 void update_age(){
@@ -788,12 +1764,123 @@ void update_age(){
   }
 }
 
+// clear the referenced bits of the resident pages, so that
+// NRU sees which pages were used during the last quantum.
+void clear_referenced(){
+  struct page_data *page;
+  struct proc *p = myproc();
+
+  for(page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++){
+    if(page->used){
+      pte_t *pte = walk(p->pagetable, page->va, 0);
+      *pte &= ~PTE_A;
+    }
+  }
+}
+
+// fill in p->ram entry page_data for a page that
+// has just become resident at virtual address va.
+void init_page(struct proc *p, struct page_data *page_data, uint64 va){
+  #ifdef SCFIFO
+    page_data->fifo_time = p->fifo_counter++;
+  #endif
+
+  #ifdef NFUA
+    page_data->age = 0;
+  #endif
+
+  #ifdef LAPA
+    page_data->age = 0xFFFFFFFF;
+  #endif
+
+  #ifdef NRU
+    page_data->fifo_time = p->fifo_counter++;
+  #endif
+
+  #ifdef ARC
+    page_data->fifo_time = p->fifo_counter++;
+    arc_admit(p, page_data, va);
+  #endif
+
+  page_data->offset = -1;
+  page_data->va = va;
+  page_data->used = 1;
+  page_data->locked = 0;
+
+  #ifdef MGLRU
+    mglru_add(p, page_data);
+  #endif
+
+  #ifdef ADAPT
+    page_data->fifo_time = p->fifo_counter++;
+    page_data->age = p->adapt.policy == POLICY_LAPA ? 0xFFFFFFFF : 0;
+  #endif
+}
+
+// forget the oldest ghost on list.
+static void drop_ghost(struct proc *p, int list){
+  int oldest = -1;
+
+  for(int i = 0; i < MAX_TOTAL_PAGES; i++)
+    if(p->ghost[i] == list && (oldest < 0 || p->ghost_time[i] < p->ghost_time[oldest]))
+      oldest = i;
+  if(oldest >= 0)
+    p->ghost[oldest] = 0;
+}
+
+// ARC: va is coming into ram. a page that left a ghost was
+// evicted too early: a ghost on B1 means T1 should get more of
+// the frames, one on B2 that T2 should. either way the page has
+// now been seen twice and goes on T2. other pages go on T1, and
+// the ghost lists are trimmed to stay within twice MAX_PSYC_PAGES.
+void arc_admit(struct proc *p, struct page_data *page_data, uint64 va){
+  int i = va / PGSIZE, t1 = 0, t2 = 0, b1 = 0, b2 = 0;
+  struct page_data *page;
+
+  page_data->list = ARC_T1;
+  page_data->lap = 0;
+  if(i >= MAX_TOTAL_PAGES)
+    return;
+
+  for(page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++){
+    if(!page->used || page == page_data)
+      continue;
+    t1 += page->list == ARC_T1;
+    t2 += page->list == ARC_T2;
+  }
+  for(int j = 0; j < MAX_TOTAL_PAGES; j++){
+    b1 += p->ghost[j] == ARC_B1;
+    b2 += p->ghost[j] == ARC_B2;
+  }
+
+  if(p->ghost[i] == ARC_B1){
+    p->arc_target += b2 / b1 > 1 ? b2 / b1 : 1;
+    if(p->arc_target > MAX_PSYC_PAGES)
+      p->arc_target = MAX_PSYC_PAGES;
+    page_data->list = ARC_T2;
+  }
+  else if(p->ghost[i] == ARC_B2){
+    p->arc_target -= b1 / b2 > 1 ? b1 / b2 : 1;
+    if(p->arc_target < 0)
+      p->arc_target = 0;
+    page_data->list = ARC_T2;
+  }
+  else if(t1 + b1 >= MAX_PSYC_PAGES){
+    drop_ghost(p, ARC_B1);
+  }
+  else if(t1 + t2 + b1 + b2 >= 2 * MAX_PSYC_PAGES){
+    drop_ghost(p, ARC_B2);
+  }
+  p->ghost[i] = 0;
+}
+
 void remove_page(struct page_data *page_data){
   page_data->used = 0;
   page_data->age = 0;
   page_data->offset = -1;
   page_data->va = -1;
   page_data->fifo_time = 0;
+  page_data->locked = 0;
 }
 
 int count_pages(struct page_data *paging_info, int flag){
@@ -24,6 +24,8 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint kvmgen;                // kvmgen when this CPU last flushed its TLB
+  int tlbflush;               // Asked by tlb_shootdown() to flush its TLB
 };
 
 extern struct cpu cpus[NCPU];
@@ -83,11 +85,39 @@ struct trapframe {
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 struct page_data{
-  int offset;
+  int offset;     // swapfile offset; in p->ram, of a clean copy or -1
   int used;
   int va;
   uint age;
   uint fifo_time;
+  int locked;     // pinned by mlock(), never evicted
+  int list;       // ARC: ARC_T1 or ARC_T2
+  int lap;        // ARC: the hand has passed it on T1 once
+  uint gen;       // MGLRU: sequence number of its generation
+};
+
+// ARC lists. a resident page is on T1 (seen once lately) or T2
+// (seen again); an evicted page leaves a ghost on B1 or B2.
+#define ARC_T1 1
+#define ARC_T2 2
+#define ARC_B1 ARC_T1
+#define ARC_B2 ARC_T2
+
+// ADAPT policies
+#define POLICY_SCFIFO 0
+#define POLICY_NFUA   1
+#define POLICY_LAPA   2
+#define NPOLICY       3
+
+// ADAPT: the policy a process runs and the faults the others
+// would have taken instead.
+struct adapt {
+  int policy;                    // POLICY_*
+  uint est[NPOLICY];             // estimated faults of each policy
+  uchar shadow[MAX_TOTAL_PAGES]; // policies that would have evicted each page
+  uint evictions;                // pages evicted so far
+  uint evict_time[MAX_TOTAL_PAGES]; // evictions when each page went out
+  uint refault_dist;             // average evictions before a page comes back
 };
 
 // Per-process state
@@ -100,21 +130,75 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int nice;                    // -20 (most CPU) to 19 (least)
+  uint64 vruntime;             // Run time, scaled by the weight of nice
+  uint64 run_start;            // time CSR when it was last switched to
+  int mem_demand;              // Working-set pages to fault in this quantum
+  int slice;                   // Clock ticks left in this quantum
 
   // proc_tree_lock must be held when using this:
   struct proc *parent;         // Parent process
+  struct proc *child;          // Most recently forked child
+  struct proc *sibling;        // Next child of the same parent
+
+  // pidhash.lock must be held when using this:
+  struct proc *pid_next;       // Next process in the same pid hash chain
+
+  // the lock of the wait queue of chan must be held when using this:
+  struct proc *wq_next;        // Next sleeper in the same wait queue
+
+  // wait_lock must be held when using these:
+  int nthreads;                // Threads clone()d into its address space
+  uint tslots;                 // Trapframe slots those threads use
+
+  // vmlock_lk must be held when using this:
+  int vmlocked;                // Its address space is vm_lock()ed
+
+  // allproc.lock must be held when using these:
+  struct proc *all_next;       // Next proc ever allocated
+  struct proc *free_next;      // Next UNUSED proc to reuse
+  int slot;                    // Where in the kernel its stack lives
 
   // these are private to the process, so p->lock need not be held.
+  struct proc *mm;             // Whose address space it runs in: itself, or
+                               // the process that clone()d it
+  int tslot;                   // Its trapframe is at TFRAME(tslot)
+  int ncopy;                   // copyin()s and copyout()s under way in it,
+                               // changed atomically
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
+  int ptpages;                 // Pages used by pagetable itself
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kfn)(void*);          // Kernel thread body, 0 for user processes
+  void *karg;                  // Its argument
   struct file *swapFile;
   struct page_data ram[MAX_PSYC_PAGES];
   struct page_data swap[MAX_PSYC_PAGES]; 
   int fifo_counter;
+  uchar advice[MAX_TOTAL_PAGES]; // madvise() hint for each page
+  uint64 fault_va;             // Page of the last page fault
+  int nlocked;                 // Pages pinned by mlock()
+  int arc_target;              // ARC: target size of T1
+  uchar ghost[MAX_TOTAL_PAGES];    // ARC: B1, B2 or 0 for each page
+  uint ghost_time[MAX_TOTAL_PAGES]; // ARC: when it became a ghost
+  uint min_seq, max_seq;       // MGLRU: oldest and youngest generation
+  uint gens[MAX_NR_GENS];      // MGLRU: p->ram indices in each generation
+  uint64 mglru_filter;         // MGLRU: page-table pages the next walk visits
+  struct adapt adapt;          // ADAPT: policy choice
+  int faults;                  // Page faults taken
+  uint wset;                   // Pages used in the last two quanta
+  uint wset_last;              // Pages used in the last quantum
+  int prepage;                 // Descheduled since the last prepage()
+  int suspend;                 // Load control: 1 if picked, 2 if swapped out
+  struct memgroup *memgroup;   // Memory group, shared with descendants
+  int swap_writes;             // Pages written to the swapfile
+  int mg_frames;               // Resident frames charged to memgroup
+  int mg_swapped;              // Swapped pages charged to memgroup
+  uint64 stall;                // Microseconds stalled on memory
+  uint64 stall_start;          // time CSR when the current stall began
 };
\ No newline at end of file
@@ -332,6 +332,8 @@ sfence_vma()
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
 #define PTE_A (1L << 6)
+#define PTE_D (1L << 7)
+#define PTE_DZ (1L << 8)  // Dropped by MADV_DONTNEED, zero-filled on next access
 #define PTE_PG (1L << 9)  // Paged out to secondary storage
 
 // shift a physical address to the right place for a PTE.
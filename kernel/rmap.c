@@ -0,0 +1,172 @@
+// Reverse map from physical frames to the user mappings
+// that refer to them.
+//
+// Every user leaf mapping (PTE_U) installed by mappages()/mappage()
+// is recorded here as a (pagetable, va) pair hanging off the frame,
+// and removed again by uvmunmap() or when a page is pushed out to
+// the swapfile. Given a frame, the kernel can then find and update
+// every PTE that maps it in O(mappers) instead of walking every
+// process's p->ram[]; eviction takes frames away this way.
+//
+// Entries are hashed by frame into NRMAPHASH chains, and carved
+// out of whole pages that go back to kalloc once their last entry
+// is freed.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NRMAPHASH 1024
+
+struct rmap {
+  uint64 pa;             // the frame
+  pagetable_t pagetable; // address space of the mapping
+  uint64 va;             // page-aligned user virtual address
+  struct rmap *next;     // next entry in the same chain
+};
+
+// head of a page of entries.
+struct rmappage {
+  struct rmappage *next; // next page of entries
+  struct rmap *free;     // unused entries on this page
+  int nused;             // entries in use on this page
+};
+
+struct {
+  struct spinlock lock;
+  struct rmap *head[NRMAPHASH]; // mappings, chained by frame
+  struct rmappage *pages;       // pages entries are carved from
+} rmap;
+
+void
+rmapinit(void)
+{
+  initlock(&rmap.lock, "rmap");
+}
+
+static struct rmap**
+chain(uint64 pa)
+{
+  if((pa % PGSIZE) != 0 || pa < KERNBASE || pa >= PHYSTOP)
+    panic("rmap: bad frame");
+  return &rmap.head[(pa / PGSIZE) % NRMAPHASH];
+}
+
+// Take an unused entry, carving a fresh page into
+// entries when all pages are full.
+// rmap.lock must be held.
+static struct rmap*
+rmap_alloc(void)
+{
+  struct rmappage *pg;
+  struct rmap *r;
+
+  for(pg = rmap.pages; pg != 0; pg = pg->next)
+    if(pg->free)
+      break;
+
+  if(pg == 0){
+    if((pg = (struct rmappage*)kalloc()) == 0)
+      return 0;
+    pg->free = 0;
+    pg->nused = 0;
+    for(r = (struct rmap*)(pg + 1); r + 1 <= (struct rmap*)((char*)pg + PGSIZE); r++){
+      r->next = pg->free;
+      pg->free = r;
+    }
+    pg->next = rmap.pages;
+    rmap.pages = pg;
+  }
+
+  r = pg->free;
+  pg->free = r->next;
+  pg->nused++;
+  return r;
+}
+
+// Give back an entry, and its page once nothing on it is used.
+// rmap.lock must be held.
+static void
+rmap_free(struct rmap *r)
+{
+  struct rmappage **pp, *pg = (struct rmappage*)PGROUNDDOWN((uint64)r);
+
+  r->next = pg->free;
+  pg->free = r;
+  if(--pg->nused > 0)
+    return;
+  for(pp = &rmap.pages; *pp != pg; pp = &(*pp)->next)
+    ;
+  *pp = pg->next;
+  kfree(pg);
+}
+
+// Record that va in pagetable maps the frame pa.
+// Returns 0 on success, -1 if no entry could be allocated.
+int
+rmap_add(uint64 pa, pagetable_t pagetable, uint64 va)
+{
+  struct rmap *r, **head = chain(pa);
+
+  acquire(&rmap.lock);
+  if((r = rmap_alloc()) == 0){
+    release(&rmap.lock);
+    return -1;
+  }
+  r->pa = pa;
+  r->pagetable = pagetable;
+  r->va = PGROUNDDOWN(va);
+  r->next = *head;
+  *head = r;
+  release(&rmap.lock);
+  return 0;
+}
+
+// Forget the mapping of pa at va in pagetable.
+// Does nothing if there is no such mapping.
+void
+rmap_remove(uint64 pa, pagetable_t pagetable, uint64 va)
+{
+  struct rmap **rp, *r;
+
+  va = PGROUNDDOWN(va);
+  acquire(&rmap.lock);
+  for(rp = chain(pa); (r = *rp) != 0; rp = &r->next){
+    if(r->pa == pa && r->pagetable == pagetable && r->va == va){
+      *rp = r->next;
+      rmap_free(r);
+      break;
+    }
+  }
+  release(&rmap.lock);
+}
+
+// Set the PTE flags in set and clear those in clear on every
+// PTE that maps the frame pa. The update is atomic against the
+// hardware setting PTE_A and PTE_D. Returns the number of PTEs
+// updated. The caller is responsible for flushing the TLB.
+int
+rmap_update(uint64 pa, uint64 set, uint64 clear)
+{
+  struct rmap *r;
+  pte_t *pte;
+  int n = 0;
+
+  acquire(&rmap.lock);
+  for(r = *chain(pa); r != 0; r = r->next){
+    if(r->pa != pa)
+      continue;
+    if((pte = walk(r->pagetable, r->va, 0)) == 0 || PTE2PA(*pte) != pa)
+      panic("rmap_update: stale mapping");
+    if(set)
+      __sync_fetch_and_or(pte, set);
+    if(clear)
+      __sync_fetch_and_and(pte, ~clear);
+    n++;
+  }
+  release(&rmap.lock);
+  return n;
+}
@@ -20,3 +20,10 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_pressurewait 22
+#define SYS_madvise 23
+#define SYS_mlock   24
+#define SYS_munlock 25
+#define SYS_memgroup 26
+#define SYS_nice    27
+#define SYS_clone   28
@@ -43,12 +43,15 @@ sys_sbrk(void)
 {
   int addr;
   int n;
+  struct proc *mm = myproc()->mm;
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
+  vm_lock(mm);
+  addr = mm->sz;
   if(growproc(n) < 0)
-    return -1;
+    addr = -1;
+  vm_unlock(mm);
   return addr;
 }
 
@@ -56,21 +59,10 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return timer_sleep(n);
 }
 
 uint64
@@ -95,3 +87,94 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// block until memory pressure reaches the given
+// per-mille threshold; return the pressure.
+uint64
+sys_pressurewait(void)
+{
+  int threshold;
+
+  if(argint(0, &threshold) < 0)
+    return -1;
+  return pressure_wait(threshold);
+}
+
+uint64
+sys_madvise(void)
+{
+  uint64 addr;
+  int len, advice, r;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &advice) < 0)
+    return -1;
+  if(len < 0)
+    return -1;
+  vm_lock(myproc()->mm);
+  r = madvise(addr, len, advice);
+  vm_unlock(myproc()->mm);
+  return r;
+}
+
+uint64
+sys_mlock(void)
+{
+  uint64 addr;
+  int len, r;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || len < 0)
+    return -1;
+  vm_lock(myproc()->mm);
+  r = mlock(addr, len);
+  vm_unlock(myproc()->mm);
+  return r;
+}
+
+uint64
+sys_munlock(void)
+{
+  uint64 addr;
+  int len, r;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || len < 0)
+    return -1;
+  vm_lock(myproc()->mm);
+  r = munlock(addr, len);
+  vm_unlock(myproc()->mm);
+  return r;
+}
+
+// move into a new memory group below the current one,
+// limited to the given resident frames and swapped pages
+// (0 for no limit). returns the group id.
+uint64
+sys_memgroup(void)
+{
+  int frames, swapped;
+
+  if(argint(0, &frames) < 0 || argint(1, &swapped) < 0)
+    return -1;
+  return mg_create(frames, swapped);
+}
+
+uint64
+sys_nice(void)
+{
+  int inc;
+
+  if(argint(0, &inc) < 0)
+    return -1;
+  return nice(inc);
+}
+
+// start a thread at fn(arg) on the given stack, sharing
+// the caller's memory. returns its pid.
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 || argaddr(2, &stack) < 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
@@ -0,0 +1,175 @@
+//
+// Timer wheel.
+//
+// Pending timers hang off a hierarchical wheel of WHEEL_LEVELS
+// levels of WHEEL_SIZE slots each. A slot of level 0 covers one
+// clock tick, and a slot of each level above covers a whole turn
+// of the level below it. A timer goes in the lowest level whose
+// turn reaches its expiry. Each tick runs the timers of one
+// level-0 slot; when level 0 comes round, the next slot of
+// level 1 is cascaded into it, and so on up. Adding, removing
+// and expiring a timer are O(1), and a tick only touches the
+// timers that are due, plus the occasional cascade.
+//
+// sleep() on a timer lets a process wait for a number of ticks
+// and be woken exactly once, at its deadline.
+//
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "timer.h"
+#include "defs.h"
+
+#define WHEEL_BITS   6
+#define WHEEL_SIZE   (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 3
+#define WHEEL_SPAN   (1L << (WHEEL_BITS * WHEEL_LEVELS)) // ticks ahead
+
+struct {
+  struct spinlock lock;
+  uint64 now;                              // ticks the wheel has turned
+  struct timer *slot[WHEEL_LEVELS][WHEEL_SIZE];
+} wheel;
+
+void
+timerwheelinit(void)
+{
+  initlock(&wheel.lock, "wheel");
+}
+
+// file t in the slot it expires in. one due now, cascaded
+// down during a tick, goes in the level-0 slot about to run.
+// a timer beyond the top level's turn is filed at the end of
+// it and cascaded again from there.
+// wheel.lock must be held.
+static void
+enqueue(struct timer *t)
+{
+  uint64 when = t->expires;
+  struct timer **head;
+  int level;
+
+  if(when < wheel.now)
+    when = wheel.now;
+  if(when - wheel.now >= WHEEL_SPAN)
+    when = wheel.now + WHEEL_SPAN - 1;
+  for(level = 0; level < WHEEL_LEVELS - 1; level++)
+    if(when - wheel.now < (1L << (WHEEL_BITS * (level + 1))))
+      break;
+
+  head = &wheel.slot[level][(when >> (WHEEL_BITS * level)) % WHEEL_SIZE];
+  t->next = *head;
+  if(t->next)
+    t->next->pprev = &t->next;
+  t->pprev = head;
+  *head = t;
+}
+
+// wheel.lock must be held.
+static void
+dequeue(struct timer *t)
+{
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+  t->next = 0;
+  t->pprev = 0;
+}
+
+// Run t->fn(t->arg) n clock ticks from now (at least one).
+// t must not be pending already. fn runs in the clock
+// interrupt with the wheel lock held, so it must not
+// block or use the timer calls.
+void
+timer_add(struct timer *t, int n)
+{
+  acquire(&wheel.lock);
+  t->expires = wheel.now + (n > 0 ? n : 1);
+  enqueue(t);
+  release(&wheel.lock);
+}
+
+// Cancel t. Returns 1 if it was pending, 0 if it had
+// already run or was never added.
+int
+timer_del(struct timer *t)
+{
+  int pending;
+
+  acquire(&wheel.lock);
+  if((pending = t->pprev != 0))
+    dequeue(t);
+  release(&wheel.lock);
+  return pending;
+}
+
+// re-file the timers of a slot of a higher level, now that
+// the wheel below has turned round to it.
+// wheel.lock must be held.
+static void
+cascade(int level)
+{
+  struct timer **head, *t;
+
+  head = &wheel.slot[level][(wheel.now >> (WHEEL_BITS * level)) % WHEEL_SIZE];
+  while((t = *head) != 0){
+    dequeue(t);
+    enqueue(t);
+  }
+}
+
+// Advance the wheel by one tick and run what is due.
+// Called by clockintr().
+void
+timer_tick(void)
+{
+  struct timer **head, *t;
+
+  acquire(&wheel.lock);
+  wheel.now++;
+  for(int level = 1; level < WHEEL_LEVELS; level++){
+    if(wheel.now % (1L << (WHEEL_BITS * level)) != 0)
+      break;
+    cascade(level);
+  }
+  head = &wheel.slot[0][wheel.now % WHEEL_SIZE];
+  while((t = *head) != 0){
+    dequeue(t);
+    t->fn(t->arg);
+  }
+  release(&wheel.lock);
+}
+
+static void
+wake(void *chan)
+{
+  wakeup(chan);
+}
+
+// Sleep for n clock ticks. Returns 0, or -1 if
+// killed before they were up.
+int
+timer_sleep(int n)
+{
+  struct timer t;
+
+  if(n <= 0)
+    return 0;
+  t.fn = wake;
+  t.arg = &t;
+  acquire(&wheel.lock);
+  t.expires = wheel.now + n;
+  enqueue(&t);
+  while(t.pprev != 0 && !myproc()->killed)
+    sleep(&t, &wheel.lock);
+  if(t.pprev != 0){
+    dequeue(&t);
+    release(&wheel.lock);
+    return -1;
+  }
+  release(&wheel.lock);
+  return 0;
+}
@@ -0,0 +1,9 @@
+// Kernel timer, run from the clock interrupt once its
+// expiry tick is reached. See timer.c.
+struct timer {
+  uint64 expires;            // tick at which fn runs
+  void (*fn)(void *);        // called with the wheel lock held
+  void *arg;                 // passed to fn
+  struct timer *next;        // next timer in the same wheel slot
+  struct timer **pprev;      // link pointing at it, 0 if not pending
+};
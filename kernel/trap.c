@@ -14,8 +14,14 @@ extern char trampoline[], uservec[], userret[];
 // in kernelvec.S, calls kerneltrap().
 void kernelvec();
 
+// in kernelvec.S, calls timervec in machine mode.
+void mcall(uint64);
+
 extern int devintr();
 
+// in start.c, shared with timervec in kernelvec.S.
+extern uint64 timer_scratch[NCPU][7];
+
 void
 trapinit(void)
 {
@@ -82,10 +88,32 @@ usertrap(void)
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // give up the CPU if this is a timer interrupt
+  // that ends the quantum.
+  if(which_dev == 2 && --p->slice <= 0)
     yield();
 
+  #ifndef NONE
+    // picked by load control: swap out and wait until let go
+    if(p->suspend == 1){
+      loadctl_wait();
+      if(p->killed)
+        exit(-1);
+    }
+
+    // back from being descheduled: bring the working set in
+    // before it is faulted in a page at a time
+    if(p->prepage){
+      stall_begin();
+      vm_lock(p);
+      prepage(p);
+      vm_unlock(p);
+      stall_end();
+      if(p->killed)
+        exit(-1);
+    }
+  #endif
+
   usertrapret();
 }
 
@@ -131,7 +159,7 @@ usertrapret(void)
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64,uint64))fn)(TFRAME(p->tslot), satp);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -155,8 +183,9 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  // give up the CPU if this is a timer interrupt
+  // that ends the quantum.
+  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING && --myproc()->slice <= 0)
     yield();
 
   // the yield() may have caused some traps to occur,
@@ -165,12 +194,42 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
+// Stop this hart's clock ticks while it idles; the next
+// tick is its last. Not for hart 0, which keeps time.
+// Interrupts must be disabled.
+void
+tick_stop(void)
+{
+  timer_scratch[cpuid()][5] = 1;
+}
+
+// Restart this hart's clock ticks if tick_stop() stopped
+// them. Interrupts must be disabled.
+void
+tick_start(void)
+{
+  uint64 *scratch = timer_scratch[cpuid()];
+
+  if(scratch[5]){
+    scratch[5] = 0;
+    mcall(-1);
+  }
+}
+
+// Interrupt hart, to wake it from wfi.
+void
+kick(int hart)
+{
+  mcall(hart);
+}
+
 void
 clockintr()
 {
   acquire(&tickslock);
   ticks++;
-  wakeup(&ticks);
+  timer_tick();
+  pressure_tick();
   release(&tickslock);
 }
 
@@ -208,17 +267,28 @@ devintr()
     return 1;
   } else if(scause == 0x8000000000000001L){
     // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // forwarded by timervec in kernelvec.S, or a kick from
+    // another hart.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
+    // the SSIP bit in sip, before looking at why, so that
+    // a reason added meanwhile raises it again.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    // timervec sets scratch[6] when it forwards a tick.
+    int tick = __sync_lock_test_and_set(&timer_scratch[cpuid()][6], 0);
+
+    if(tick && cpuid() == 0){
+      clockintr();
+    }
+
+    // asked by tlb_shootdown() on another hart.
+    if(mycpu()->tlbflush){
+      sfence_vma();
+      mycpu()->tlbflush = 0;
+    }
+
+    return tick ? 2 : 1;
   } else {
     return 0;
   }
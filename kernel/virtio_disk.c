@@ -61,8 +61,9 @@ static struct disk {
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct buf *b;   // or 0 for a virtio_disk_writev()
     char status;
+    char done;       // a virtio_disk_writev() has finished
   } info[NUM];
 
   // disk command headers.
@@ -184,12 +185,11 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -200,6 +200,14 @@ alloc3_desc(int *idx)
   return 0;
 }
 
+// allocate three descriptors.
+// single block transfers always use three descriptors.
+static int
+alloc3_desc(int *idx)
+{
+  return alloc_descs(idx, 3);
+}
+
 void
 virtio_disk_rw(struct buf *b, int write)
 {
@@ -279,6 +287,65 @@ virtio_disk_rw(struct buf *b, int write)
   release(&disk.vdisk_lock);
 }
 
+// Write n pieces of memory, data[i] of len[i] bytes each a
+// multiple of BSIZE, to consecutive blocks starting at blockno,
+// as one request: the device gathers the pieces itself, so
+// they can be page frames as they are. n is at most NUM-2.
+void
+virtio_disk_writev(uint blockno, char **data, uint *len, int n)
+{
+  int idx[NUM];
+
+  if(n < 1 || n > NUM - 2)
+    panic("virtio_disk_writev");
+
+  acquire(&disk.vdisk_lock);
+
+  // a type/reserved/sector descriptor, one for each piece
+  // and one for the status, as for a single block.
+  while(alloc_descs(idx, n + 2) < 0)
+    sleep(&disk.free[0], &disk.vdisk_lock);
+
+  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
+  buf0->type = VIRTIO_BLK_T_OUT;
+  buf0->reserved = 0;
+  buf0->sector = blockno * (BSIZE / 512);
+
+  disk.desc[idx[0]].addr = (uint64) buf0;
+  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
+  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
+  disk.desc[idx[0]].next = idx[1];
+
+  for(int i = 0; i < n; i++){
+    disk.desc[idx[i+1]].addr = (uint64) data[i];
+    disk.desc[idx[i+1]].len = len[i];
+    disk.desc[idx[i+1]].flags = VRING_DESC_F_NEXT; // device reads data[i]
+    disk.desc[idx[i+1]].next = idx[i+2];
+  }
+
+  disk.info[idx[0]].status = 0xff; // device writes 0 on success
+  disk.desc[idx[n+1]].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[idx[n+1]].len = 1;
+  disk.desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[n+1]].next = 0;
+
+  disk.info[idx[0]].b = 0;
+  disk.info[idx[0]].done = 0;
+
+  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  __sync_synchronize();
+  disk.avail->idx += 1;
+  __sync_synchronize();
+  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+
+  while(disk.info[idx[0]].done == 0)
+    sleep(&disk.info[idx[0]], &disk.vdisk_lock);
+
+  free_chain(idx[0]);
+
+  release(&disk.vdisk_lock);
+}
+
 void
 virtio_disk_intr()
 {
@@ -305,8 +372,13 @@ virtio_disk_intr()
       panic("virtio_disk_intr status");
 
     struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    if(b){
+      b->disk = 0;   // disk is done with buf
+      wakeup(b);
+    } else {
+      disk.info[id].done = 1;
+      wakeup(&disk.info[id]);
+    }
 
     disk.used_idx += 1;
   }
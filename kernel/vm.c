@@ -7,18 +7,47 @@
 #include "fs.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "mman.h"
 
 /*
  * the kernel's page table.
  */
 pagetable_t kernel_pagetable;
 
+// kernel stacks come and go with processes after boot.
+// kvm_lock guards those changes to kernel_pagetable, and
+// kvmgen counts them, so each CPU can tell when its TLB
+// may hold a stale kernel stack mapping.
+struct spinlock kvm_lock;
+uint kvmgen;
+
 extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
-void swap(uint64 va, pte_t *pte);
+// get_ram_slot() and zero_fill() fail with SWAPQUOTA when making
+// room would go over the swap limit of the memory group, and with
+// -1 when there is no frame, no room in the swapfile or the write
+// to it fails.
+#define SWAPQUOTA -2
+
+int swap(uint64 va, pte_t *pte);
 int exchange_pages(uint64 va_on_swap, int in_swap);
+int get_ram_slot(struct proc *p, uint64 va);
+static int alloc_swap_slot(struct proc *p, uint64 va);
+void nru_preclean(struct proc *p);
+int evictable(struct proc *p, struct page_data *page);
+int zero_fill(uint64 va, pte_t *pte);
+static void out_of_memory(struct proc *p);
+void readahead(struct proc *p, uint64 va);
+int get_behind_index(struct proc *p);
+static void freeempty(pagetable_t pagetable, uint64 va);
+#ifdef ARC
+static void arc_evict(struct proc *p, struct page_data *page);
+#endif
+#ifdef ADAPT
+static void adapt_evict(struct proc *p, struct page_data *page);
+#endif
 
 // Make a direct-map page table for the kernel.
 pagetable_t kvmmake(void)
@@ -47,18 +76,95 @@ pagetable_t kvmmake(void)
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // map kernel stacks
-  proc_mapstacks(kpgtbl);
-  
   return kpgtbl;
 }
 
 // Initialize the one kernel_pagetable
 void kvminit(void)
 {
+  initlock(&kvm_lock, "kvm");
   kernel_pagetable = kvmmake();
 }
 
+// Map a new kernel stack page at va, with the invalid guard
+// page below it left unmapped.
+// Returns 0, or -1 if out of memory.
+int kvmmapstack(uint64 va)
+{
+  char *pa;
+
+  if((pa = kalloc()) == 0)
+    return -1;
+  acquire(&kvm_lock);
+  if(mappages(kernel_pagetable, va, PGSIZE, (uint64)pa, PTE_R | PTE_W) < 0){
+    release(&kvm_lock);
+    kfree(pa);
+    return -1;
+  }
+  kvmgen++;
+  release(&kvm_lock);
+  return 0;
+}
+
+// Unmap and free the kernel stack page at va.
+void kvmunmapstack(uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+
+  acquire(&kvm_lock);
+  if((pte = walk(kernel_pagetable, va, 0)) == 0 || (*pte & PTE_V) == 0)
+    panic("kvmunmapstack");
+  pa = PTE2PA(*pte);
+  *pte = 0;
+  kvmgen++;
+  release(&kvm_lock);
+  sfence_vma();
+  kfree((void*)pa);
+}
+
+// Flush this CPU's TLB if kernel stacks were mapped or
+// unmapped since it last did, before it runs on one.
+// Interrupts must be disabled.
+void kvmsync(void)
+{
+  struct cpu *c = mycpu();
+
+  if(c->kvmgen != kvmgen){
+    c->kvmgen = kvmgen;
+    sfence_vma();
+  }
+}
+
+// Flush the TLBs of the other harts running in pagetable, once
+// entries of it have been cleared or lost PTE_V or PTE_D, and
+// wait for copyin()s and copyout()s under way in it; the frames
+// they mapped can then be written out or reused. Only threads
+// made by clone() run in a page table together, so mostly this
+// finds nothing to do.
+void tlb_shootdown(pagetable_t pagetable)
+{
+  struct proc *me = myproc(), *p;
+  struct cpu *c;
+
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    p = c->proc;
+    if(p == 0 || p == me || p->pagetable != pagetable)
+      continue;
+    c->tlbflush = 1;
+    __sync_synchronize();
+    kick(c - cpus);
+    // done once it has flushed, or switched away: it flushes
+    // on its way back to user space anyway.
+    while(c->tlbflush && c->proc == p)
+      __sync_synchronize();
+  }
+
+  if(me != 0 && me->mm != 0 && me->mm->pagetable == pagetable)
+    while(me->mm->ncopy > 0)
+      yield();
+}
+
 // Switch h/w page table register to the kernel's page table,
 // and enable paging.
 void kvminithart()
@@ -81,6 +187,8 @@ void kvminithart()
 //    0..11 -- 12 bits of byte offset within the page.
 pte_t *walk(pagetable_t pagetable, uint64 va, int alloc)
 {
+  pagetable_t root = pagetable;
+
   if(va >= MAXVA)
     panic("walk");
 
@@ -94,11 +202,67 @@ pte_t *walk(pagetable_t pagetable, uint64 va, int alloc)
         return 0;
       memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
+      ptaccount(root, 1);
     }
   }
   return &pagetable[PX(0, va)];
 }
 
+// Charge n page-table pages to the current process,
+// if pagetable is its address space.
+void ptaccount(pagetable_t pagetable, int n)
+{
+  struct proc *p = mmproc();
+
+  if(p != 0 && p->pagetable == pagetable)
+    p->ptpages += n;
+}
+
+// Count the page-table pages of pagetable, including itself.
+// level is the level of pagetable, 2 for a root.
+int uvmptpages(pagetable_t pagetable, int level)
+{
+  int n = 1;
+
+  if(level == 0)
+    return n;
+
+  for(int i = 0; i < 512; i++){
+    pte_t pte = pagetable[i];
+    if((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0)
+      n += uvmptpages((pagetable_t)PTE2PA(pte), level - 1);
+  }
+  return n;
+}
+
+// Free the level-0 and level-1 page-table pages that map va
+// once uvmunmap() has left them without any entries, so that
+// a shrinking heap gives its page-table pages back right away
+// instead of at freewalk() time. The root is never freed.
+static void freeempty(pagetable_t pagetable, uint64 va)
+{
+  pagetable_t pt[3];
+  pte_t *pde[3];
+
+  pt[2] = pagetable;
+  for(int level = 2; level > 0; level--) {
+    pde[level] = &pt[level][PX(level, va)];
+    if((*pde[level] & PTE_V) == 0 || (*pde[level] & (PTE_R|PTE_W|PTE_X)) != 0)
+      return;
+    pt[level-1] = (pagetable_t)PTE2PA(*pde[level]);
+  }
+
+  for(int level = 0; level < 2; level++) {
+    for(int i = 0; i < 512; i++)
+      if(pt[level][i] != 0)
+        return;
+    *pde[level+1] = 0;
+    tlb_shootdown(pagetable);
+    kfree((void*)pt[level]);
+    ptaccount(pagetable, -1);
+  }
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -144,6 +308,8 @@ int mappages_NONE(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int
       if (walkaddr(pagetable,va) != 0)
         panic("remap");
     
+    if((perm & PTE_U) && rmap_add(pa, pagetable, a) != 0)
+      return -1;
     *pte = PA2PTE(pa) | perm | PTE_V;
     if(a == last)
       break;
@@ -166,6 +332,8 @@ int mappages_not_NONE(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa,
     if(*pte & PTE_V)
       panic("remap");
 
+    if((perm & PTE_U) && rmap_add(pa, pagetable, a) != 0)
+      return -1;
     *pte = PA2PTE(pa) | perm | PTE_V;
     if(a == last)
       break;
@@ -177,8 +345,9 @@ int mappages_not_NONE(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa,
 
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
-// be page-aligned. Returns 0 on success, -1 if walk() couldn't
-// allocate a needed page-table page.
+// be page-aligned. User mappings are recorded in the reverse map.
+// Returns 0 on success, -1 if walk() couldn't allocate a needed
+// page-table page or the reverse map entry couldn't be allocated.
 int mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
     #ifdef NONE
@@ -201,6 +370,8 @@ int mappage(pagetable_t pagetable, uint64 va, uint64 pa, int perm)
     return -1;
   if(*pte & PTE_V)
     panic("remap");
+  if((perm & PTE_U) && rmap_add(pa, pagetable, a) != 0)
+    return -1;
   *pte = PA2PTE(pa) | perm | PTE_V;
 
   return 0;
@@ -224,61 +395,103 @@ void uvmunmap_NONE(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
       if (walkaddr(pagetable,va) != 0)
         panic("uvmunmap: not a leaf");
 
+    if (PTE2PA(*pte) != 0)
+      rmap_remove(PTE2PA(*pte), pagetable, a);
+
     if(do_free){
       if (walkaddr(pagetable, va) != 0){
         uint64 pa = PTE2PA(*pte);
+        *pte = 0;
+        tlb_shootdown(pagetable);
         kfree((void*)pa);
       }
     }
   
     *pte = 0;
+
+    // done with the last entry of a level-0 page-table page
+    if(PX(0, a) == 511 || a + PGSIZE == va + npages*PGSIZE)
+      freeempty(pagetable, a);
   }
 }
 
 void uvmunmap_not_NONE(pagetable_t pagetable, uint64 va, uint64 npages, int do_free){
   struct proc *p;
+  int own;
   uint64 a;
   pte_t *pte;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
+  // only the caller's own pages are in its p->ram and p->swap,
+  // not those of a child being reaped or an image exec() replaced.
+  // its own are changed under its vm_lock(), against faults in
+  // its threads.
+  p = mmproc();
+  own = p != 0 && p->pid > 2 && p->pagetable == pagetable;
+  if(own && !p->vmlocked)
+    panic("uvmunmap: not vm_locked");
+
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
     if((pte = walk(pagetable, a, 0)) == 0)
       panic("uvmunmap: walk");
 
     if((*pte & PTE_V) == 0)
-      if ((*pte & PTE_PG) == 0)
+      if ((*pte & (PTE_PG|PTE_DZ)) == 0)
         panic("uvmunmap: not mapped");
 
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
 
+    if ((*pte & (PTE_PG|PTE_DZ)) == 0)
+      rmap_remove(PTE2PA(*pte), pagetable, a);
+
     if(do_free) {
-      if ((*pte & PTE_PG) == 0){
+      if ((*pte & (PTE_PG|PTE_DZ)) == 0){
         uint64 pa = PTE2PA(*pte);
+        *pte = 0;
+        tlb_shootdown(pagetable);
         kfree((void*)pa);
       }
     }
 
     *pte = 0;
-    p = myproc();
 
-    if(p->pid > 2){
+    if(own){
       for (int i=0; i < MAX_PSYC_PAGES; i++){
-        if (p->ram[i].va == a)
+        if (p->ram[i].va == a){
+          if (p->ram[i].locked)
+            p->nlocked--;
           remove_page(&p->ram[i]);
+        }
 
         if (p->swap[i].va == a)
           remove_page(&p->swap[i]);
       } 
+      #ifdef ARC
+        if (a / PGSIZE < MAX_TOTAL_PAGES)
+          p->ghost[a / PGSIZE] = 0;
+      #endif
+      #ifdef ADAPT
+        if (a / PGSIZE < MAX_TOTAL_PAGES)
+          p->adapt.shadow[a / PGSIZE] = 0;
+      #endif
     }
+
+    // done with the last entry of a level-0 page-table page
+    if(PX(0, a) == 511 || a + PGSIZE == va + npages*PGSIZE)
+      freeempty(pagetable, a);
   }
+
+  if(own)
+    mg_sync(p);
 }
 
 // Remove npages of mappings starting from va. va must be
 // page-aligned. The mappings must exist.
 // Optionally free the physical memory.
+// Page-table pages left empty are freed.
 void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
   #ifdef NONE
@@ -331,41 +544,39 @@ uint64 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz) {
 
   for(a = oldsz; a < newsz; a += PGSIZE){
     #ifndef NONE
-      struct proc *p = myproc();
+      struct proc *p = mmproc();
       int idx = 0;
 
       if (p->pid > 2){
-        if (!(a / PGSIZE < MAX_TOTAL_PAGES)) 
-          panic("process cannot be larger than 32 pages");
+        // no room to page it out
+        if (!(a / PGSIZE < MAX_TOTAL_PAGES)){
+          uvmdealloc(pagetable, a, oldsz);
+          return 0;
+        }
 
         // when not called from exec
         if (p->pagetable == pagetable){
-          if (count_pages(p->ram, 1) < MAX_PSYC_PAGES){
-            struct page_data *page;
-            for (page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++){
-              if (page->used == 0){
-                idx = (int)(page - p->ram);
-                break;
-              }
-            }
-          }
-          else 
-          {
-            idx = exchange_pages(a, 0);
+          stall_begin();
+          idx = get_ram_slot(p, a);
+          stall_end();
+          if (idx < 0){
+            uvmdealloc(pagetable, a, oldsz);
+            return 0;
           }
         }
       }
     #endif
 
-    mem = kalloc();
+    mem = kzalloc();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
+      out_of_memory(mmproc());
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W | PTE_X | PTE_R | PTE_U) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
+      out_of_memory(mmproc());
       return 0;
     }
 
@@ -373,23 +584,8 @@ uint64 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz) {
       if (p->pid > 2){
         if (p->pagetable == pagetable){
           // add page to p->ram
-          struct page_data *page_data = &p->ram[idx];
-
-          #ifdef SCFIFO
-            page_data->fifo_time = p->fifo_counter++;
-          #endif
-
-          #ifdef NFUA
-            page_data->age = 0;
-          #endif
-
-          #ifdef LAPA
-            page_data->age = 0xFFFFFFFF;
-          #endif
-
-          page_data->offset = -1;
-          page_data->va = a;
-          page_data->used = 1;
+          init_page(p, &p->ram[idx], a);
+          mg_sync(p);
 
           // turn on valid bit
           pte_t *pte = walk(p->pagetable, a, 0);
@@ -499,14 +695,14 @@ int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   uint flags;
   char *mem;
   pte_t *new_pte;
-  struct proc *p = myproc();
+  struct proc *p = mmproc();
 
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walk(old, i, 0)) == 0)
       panic("uvmcopy: pte should exist");
 
     #ifndef NONE
-      if (p->pid > 2 && (*pte & PTE_PG)){
+      if (p->pid > 2 && (*pte & (PTE_PG|PTE_DZ))){
         if((new_pte = walk(new, i, 0)) == 0) {
           return -1;   
         }
@@ -561,28 +757,54 @@ void uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// A copy to or from the caller's own address space counts
+// itself in p->ncopy while it runs, so that tlb_shootdown() in
+// another thread of p can wait for it to be done with a frame.
+static struct proc* copy_begin(pagetable_t pagetable)
+{
+  struct proc *p = mmproc();
+
+  if(p == 0 || p->pagetable != pagetable)
+    return 0;
+  __sync_fetch_and_add(&p->ncopy, 1);
+  return p;
+}
+
+static void copy_end(struct proc *p)
+{
+  if(p)
+    __sync_fetch_and_sub(&p->ncopy, 1);
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
 int copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  struct proc *mm = copy_begin(pagetable);
+  int r = 0;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
     pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
+    if(pa0 == 0){
+      r = -1;
+      break;
+    }
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
     memmove((void *)(pa0 + (dstva - va0)), src, n);
+    // the MMU didn't see this write
+    __sync_fetch_and_or(walk(pagetable, va0, 0), PTE_D);
 
     len -= n;
     src += n;
     dstva = va0 + PGSIZE;
   }
-  return 0;
+  copy_end(mm);
+  return r;
 }
 
 // Copy from user to kernel.
@@ -591,12 +813,16 @@ int copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 int copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
+  struct proc *mm = copy_begin(pagetable);
+  int r = 0;
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
+    if(pa0 == 0){
+      r = -1;
+      break;
+    }
     n = PGSIZE - (srcva - va0);
     if(n > len)
       n = len;
@@ -606,7 +832,8 @@ int copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
     dst += n;
     srcva = va0 + PGSIZE;
   }
-  return 0;
+  copy_end(mm);
+  return r;
 }
 
 // Copy a null-terminated string from user to kernel.
@@ -617,12 +844,13 @@ int copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
   uint64 n, va0, pa0;
   int got_null = 0;
+  struct proc *mm = copy_begin(pagetable);
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
     if(pa0 == 0)
-      return -1;
+      break;
     n = PGSIZE - (srcva - va0);
     if(n > max)
       n = max;
@@ -645,6 +873,7 @@ int copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
     srcva = va0 + PGSIZE;
   }
+  copy_end(mm);
   if(got_null){
     return 0;
   }
@@ -653,8 +882,14 @@ int copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   }
 }
 
+// push the page at va_on_ram out to the swapfile, bringing the
+// page at va_on_swap into its frame slot when in_swap is set.
+// returns the p->ram index that was given up, or -1 if memory
+// or the swapfile ran out; the victim is then left in ram,
+// unless in_swap had already taken its slot, in which case p
+// is killed.
 int swap_pages(int va_on_swap, int va_on_ram, int in_swap){
-  struct proc *p = myproc();  
+  struct proc *p = mmproc();  
 
   // get the pte of the page with virtual address "va_on_ram"
   pte_t *pte = walk(p->pagetable, va_on_ram, 0);
@@ -674,15 +909,24 @@ int swap_pages(int va_on_swap, int va_on_ram, int in_swap){
     panic("error when trying to locate a page in RAM");
 
   // remove the page with virtual address "va_on_ram" from ram
-  *pte &= ~(PTE_V);
+  int victim_off = p->ram[ram_arr_index].offset;
+  uint64 pa = PTE2PA(*pte);
+  rmap_update(pa, 0, PTE_V);
+  tlb_shootdown(p->pagetable);
   remove_page(&p->ram[ram_arr_index]);
 
   int swap_arr_index = 0;
   if (in_swap == 1){
     // move the page with virtual address "va_on_swap" into ram
     // and store in "swap_arr_index" the available space in p->swap
-    pte = walk(p->pagetable, va_on_swap, 0);
-    swap_arr_index = swapfile_to_ram(va_on_swap, pte, ram_arr_index);
+    swap_arr_index = swapfile_to_ram(va_on_swap, walk(p->pagetable, va_on_swap, 0), ram_arr_index);
+    if (swap_arr_index < 0){
+      // out of memory: put the victim back
+      rmap_update(pa, PTE_V, 0);
+      init_page(p, &p->ram[ram_arr_index], va_on_ram);
+      p->ram[ram_arr_index].offset = victim_off;
+      return -1;
+    }
   }
   else {
     // find the first available space in p->swap
@@ -694,16 +938,31 @@ int swap_pages(int va_on_swap, int va_on_ram, int in_swap){
     }
   }
 
-  // write the page with virtual address "va_on_ram" to swapfile
-  int off = swap_arr_index * PGSIZE;
-  char *page = kalloc();
-  pte = walk(p->pagetable, va_on_ram, 0);
-  memmove(page, (void *)PTE2PA(*pte), PGSIZE);
-
-  if ((writeToSwapFile(p, page, off, PGSIZE)) == -1)
-    panic("error when trying to write to swapfile");
+  // a page that still has its clean copy in the swapfile
+  // isn't written again
+  int clean = 0;
+  #ifdef NRU
+    clean = victim_off >= 0 && (*pte & PTE_D) == 0;
+  #endif
+  int off = victim_off >= 0 ? victim_off : alloc_swap_slot(p, va_on_ram);
+
+  // write the page with virtual address "va_on_ram" to swapfile,
+  // straight from its frame
+  char *frame = (char *)pa;
+  if (!clean && (off < 0 || writePagesToSwapFile(p, &frame, (uint *)&off, 1) < 0)){
+    // the victim is still intact in its frame
+    rmap_update(pa, PTE_V, 0);
+    if (in_swap == 1)
+      p->killed = 1; // its p->ram slot is gone
+    else {
+      init_page(p, &p->ram[ram_arr_index], va_on_ram);
+      p->ram[ram_arr_index].offset = victim_off;
+    }
+    return -1;
+  }
 
-  kfree(page);
+  if (!clean)
+    p->swap_writes++;
 
   // write page data for the page with virtual address "va_on_ram" to p->swap
   page_data = &p->swap[swap_arr_index];
@@ -713,25 +972,211 @@ int swap_pages(int va_on_swap, int va_on_ram, int in_swap){
 
   // remove the mapping of the page that was removed from the ram
   // and turn on it's PTE_PG bit
-  *pte |= PTE_PG;   //turn on PTE_PG
-  kfree((void*)PTE2PA(*pte));
+  rmap_update(pa, PTE_PG, 0);   //turn on PTE_PG
+  rmap_remove(pa, p->pagetable, va_on_ram);
+  kfree((void*)pa);
+
+  #ifdef NRU
+    // no write was needed this time; spend it on the next victim
+    if (clean)
+      nru_preclean(p);
+  #endif
   
   return ram_arr_index;
 }
 
+// Swap slots. A process's swapfile is cut into clusters of
+// SWAP_CLUSTER slots, and each cluster belongs to one run of
+// SWAP_CLUSTER virtual pages, which always sit at the same
+// position in it. Neighbouring virtual pages are then also
+// neighbours in the swapfile, so runs of them can be read and
+// written sequentially. A cluster is given out whole, to the
+// first run that needs a slot while it is empty, and can be
+// reused by another run once all its slots are free again.
+//
+// The slots in use are exactly the offsets held by p->swap and
+// by the clean copies in p->ram, so the bitmap is built from them
+// when a slot is needed rather than kept in sync by every path
+// that lets a page go.
+
+#define SWAP_CLUSTER 4
+#define NSWAPSLOTS   MAX_TOTAL_PAGES
+
+// bitmap of the swap slots p is using.
+static uint swap_map(struct proc *p){
+  uint map = 0;
+
+  for (int i = 0; i < MAX_PSYC_PAGES; i++){
+    if (p->swap[i].used)
+      map |= 1 << (p->swap[i].offset / PGSIZE);
+    if (p->ram[i].used && p->ram[i].offset >= 0)
+      map |= 1 << (p->ram[i].offset / PGSIZE);
+  }
+  return map;
+}
+
+// the cluster holding the run of va, or -1 if it has none.
+static int swap_cluster(struct proc *p, uint64 va){
+  uint64 run = va / PGSIZE / SWAP_CLUSTER;
+
+  for (int i = 0; i < MAX_PSYC_PAGES; i++){
+    if (p->swap[i].used && p->swap[i].va / PGSIZE / SWAP_CLUSTER == run)
+      return p->swap[i].offset / PGSIZE / SWAP_CLUSTER;
+    if (p->ram[i].used && p->ram[i].offset >= 0 && p->ram[i].va / PGSIZE / SWAP_CLUSTER == run)
+      return p->ram[i].offset / PGSIZE / SWAP_CLUSTER;
+  }
+  return -1;
+}
+
+// the swapfile offset for the page at va: its place in the
+// cluster of its run, taking the first empty cluster if the run
+// has none yet. returns -1 if there is no empty cluster, the
+// place is taken, or the swapfile can't grow to it.
+static int alloc_swap_slot(struct proc *p, uint64 va){
+  uint map = swap_map(p);
+  uint mask = (1 << SWAP_CLUSTER) - 1;
+  int c = swap_cluster(p, va);
+
+  if (c < 0){
+    for (c = 0; c < NSWAPSLOTS / SWAP_CLUSTER; c++)
+      if ((map & (mask << (c * SWAP_CLUSTER))) == 0)
+        break;
+    if (c == NSWAPSLOTS / SWAP_CLUSTER)
+      return -1;
+  }
+
+  int slot = c * SWAP_CLUSTER + (va / PGSIZE) % SWAP_CLUSTER;
+  if ((map & (1 << slot)) || extendSwapFile(p, slot * PGSIZE) < 0)
+    return -1;
+  return slot * PGSIZE;
+}
+
+// push the n resident pages at p->ram indices idx out to the
+// swapfile in one batch: reserve a slot for each, sort them by
+// it and write them straight from their frames. all or nothing;
+// returns 0, or -1 with nothing evicted.
+static int page_out_batch(struct proc *p, int *idx, int n){
+  char *frames[MAX_PSYC_PAGES];
+  uint offs[MAX_PSYC_PAGES];
+  int sorted[MAX_PSYC_PAGES], old[MAX_PSYC_PAGES];
+  int nw = 0;
+  pte_t *pte;
+
+  for (int i = 0; i < n; i++){
+    struct page_data *page = &p->ram[idx[i]];
+    old[i] = page->offset;
+    if (page->offset < 0 && (page->offset = alloc_swap_slot(p, page->va)) < 0){
+      while (i >= 0){
+        p->ram[idx[i]].offset = old[i];
+        i--;
+      }
+      return -1;
+    }
+    int j = i;
+    for (; j > 0 && p->ram[idx[sorted[j-1]]].offset > page->offset; j--)
+      sorted[j] = sorted[j-1];
+    sorted[j] = i;
+  }
+
+  // take the pages away first, so that no other thread of p
+  // changes them while they are written
+  for (int i = 0; i < n; i++)
+    rmap_update(PTE2PA(*walk(p->pagetable, p->ram[idx[i]].va, 0)), 0, PTE_V);
+  tlb_shootdown(p->pagetable);
+
+  // a page that still has its clean copy in the swapfile
+  // isn't written again
+  for (int i = 0; i < n; i++){
+    struct page_data *page = &p->ram[idx[sorted[i]]];
+    pte = walk(p->pagetable, page->va, 0);
+    #ifdef NRU
+      if (old[sorted[i]] >= 0 && (*pte & PTE_D) == 0)
+        continue;
+    #endif
+    frames[nw] = (char *)PTE2PA(*pte);
+    offs[nw++] = page->offset;
+  }
+
+  if (writePagesToSwapFile(p, frames, offs, nw) < 0){
+    for (int i = 0; i < n; i++){
+      p->ram[idx[i]].offset = old[i];
+      rmap_update(PTE2PA(*walk(p->pagetable, p->ram[idx[i]].va, 0)), PTE_V, 0);
+    }
+    return -1;
+  }
+
+  for (int i = 0; i < n; i++){
+    struct page_data *page = &p->ram[idx[i]];
+    struct page_data *s = p->swap;
+    while (s->used)
+      s++;
+    s->va = page->va;
+    s->offset = page->offset;
+    s->used = 1;
+
+    #ifdef ARC
+      arc_evict(p, page);
+    #endif
+    #ifdef ADAPT
+      adapt_evict(p, page);
+    #endif
+
+    uint64 pa = PTE2PA(*walk(p->pagetable, page->va, 0));
+    rmap_update(pa, PTE_PG, 0);
+    rmap_remove(pa, p->pagetable, page->va);
+    kfree((void *)pa);
+    remove_page(page);
+  }
+  p->swap_writes += nw;
+  sfence_vma();
+  mg_sync(p);
+  return 0;
+}
+
+// free p->swap entries p may still fill, as allowed by the
+// swap limits of its memory groups.
+static int swap_room(struct proc *p){
+  int room = 0;
+
+  for (int i = 0; i < MAX_PSYC_PAGES; i++)
+    room += !p->swap[i].used;
+  int mg_room = mg_swap_room(p);
+  return room < mg_room ? room : mg_room;
+}
+
+// load control: push every evictable resident page of p out to
+// the swapfile at once.
+void swap_out_all(struct proc *p){
+  int idx[MAX_PSYC_PAGES];
+  int n = 0, room;
+
+  if (p->pid <= 2)
+    return;
+  room = swap_room(p);
+  for (int i = 0; i < MAX_PSYC_PAGES && n < room; i++)
+    if (evictable(p, &p->ram[i]))
+      idx[n++] = i;
+  page_out_batch(p, idx, n);
+}
+
+// can the page in p->ram be chosen as a victim?
+// the stack guard page (PTE_U off) and mlock()ed pages can't.
+int evictable(struct proc *p, struct page_data *page){
+  if (!page->used || page->locked)
+    return 0;
+  return (*walk(p->pagetable, page->va, 0) & PTE_U) != 0;
+}
+
 int get_NFUA_index() {
-  struct proc *p = myproc();
+  struct proc *p = mmproc();
   struct page_data *page;
-  pte_t *pte;
   uint age = 0;
   int page_num = 0;
   int first = 1;
 
   for(int i=0; i < MAX_PSYC_PAGES; i++){
     page = &p->ram[i];
-    pte = walk(p->pagetable, page->va, 0);
-
-    if ((*pte & PTE_U) == 0){
+    if (!evictable(p, page)){
       continue;
     }
 
@@ -745,9 +1190,8 @@ int get_NFUA_index() {
 }
 
 int get_LAPA_index(){
-  struct proc *p = myproc();
+  struct proc *p = mmproc();
   struct page_data *page;
-  pte_t *pte;
   uint age = 0;
   int page_num = 0;
   int first = 1;
@@ -755,9 +1199,7 @@ int get_LAPA_index(){
 
   for (int i = 0; i < MAX_PSYC_PAGES; i++){
     page = &p->ram[i];
-    pte = walk(p->pagetable, page->va, 0);
-
-    if ((*pte & PTE_U) == 0){
+    if (!evictable(p, page)){
       continue;
     }
 
@@ -781,8 +1223,131 @@ int get_LAPA_index(){
   return page_num;
 }
 
+// does evicting the resident page cost a write? yes unless the
+// swapfile holds a copy it hasn't been written since.
+static int nru_dirty(struct page_data *page, pte_t *pte){
+  return page->offset < 0 || (*pte & PTE_D);
+}
+
+// NRU: evict from the lowest class of (referenced, dirty),
+// oldest first within a class. referenced bits are cleared
+// every time the process is scheduled.
+int get_NRU_index(){
+  struct proc *p = mmproc();
+  struct page_data *page;
+  pte_t *pte;
+  int page_num = 0;
+  int best = 4;
+  uint time = 0;
+
+  for (page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++){
+    if (!evictable(p, page))
+      continue;
+
+    pte = walk(p->pagetable, page->va, 0);
+    int class = ((*pte & PTE_A) ? 2 : 0) + nru_dirty(page, pte);
+    if (class < best || (class == best && page->fifo_time < time)){
+      best = class;
+      time = page->fifo_time;
+      page_num = (int)(page - p->ram);
+    }
+  }
+  return page_num;
+}
+
+// write back one unreferenced dirty page ahead of time, so that
+// it is clean when NRU gets to it.
+void nru_preclean(struct proc *p){
+  struct page_data *page;
+  pte_t *pte;
+
+  for (page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++){
+    if (!evictable(p, page))
+      continue;
+
+    pte = walk(p->pagetable, page->va, 0);
+    if ((*pte & PTE_A) || !nru_dirty(page, pte))
+      continue;
+
+    int off = page->offset >= 0 ? page->offset : alloc_swap_slot(p, page->va);
+    char *frame = (char *)PTE2PA(*pte);
+    if (off < 0)
+      return;
+    // clean before the write, so that a store by another thread
+    // of p while it is written leaves the page dirty
+    __sync_fetch_and_and(pte, ~PTE_D);
+    tlb_shootdown(p->pagetable);
+    if (writePagesToSwapFile(p, &frame, (uint *)&off, 1) < 0){
+      __sync_fetch_and_or(pte, PTE_D);
+      return;
+    }
+    p->swap_writes++;
+    page->offset = off;
+    sfence_vma();
+    return;
+  }
+}
+
+// ARC, as the CAR clock variant: T1 and T2 are clocks ordered
+// by fifo_time. the hand sweeps T1 while it is over its target
+// size and T2 otherwise; a referenced page gets its PTE_A cleared
+// and goes to the tail of T2 (a T1 page only on its second
+// pass), the first one that isn't is the victim. a one-time
+// scan only ever fills T1, so the pages that were used twice
+// stay in T2.
+int get_ARC_index(){
+  struct proc *p = mmproc();
+  struct page_data *page, *head;
+  pte_t *pte;
+  int t1, list;
+
+  for(;;){
+    t1 = 0;
+    for (page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++)
+      if (evictable(p, page) && page->list == ARC_T1)
+        t1++;
+    list = (t1 > 0 && t1 >= (p->arc_target > 1 ? p->arc_target : 1)) ? ARC_T1 : ARC_T2;
+
+    // the head of the list, or of the other one if it is empty
+    head = 0;
+    for (page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++){
+      if (!evictable(p, page))
+        continue;
+      if (head == 0 || (page->list == list && head->list != list) ||
+          (page->list == head->list && page->fifo_time < head->fifo_time))
+        head = page;
+    }
+    if (head == 0)
+      return 0;
+
+    pte = walk(p->pagetable, head->va, 0);
+    if ((*pte & PTE_A) == 0)
+      return (int)(head - p->ram);
+    __sync_fetch_and_and(pte, ~PTE_A);
+    // the access that faulted a page in also sets PTE_A, so the
+    // first pass over a T1 page only clears it. a page read once
+    // by a scan then leaves from T1 instead of reaching T2.
+    if (head->list == ARC_T1 && !head->lap)
+      head->lap = 1;
+    else
+      head->list = ARC_T2;
+    head->fifo_time = p->fifo_counter++;
+  }
+}
+
+#ifdef ARC
+// ARC: the page is being evicted; remember it on B1 if it came
+// from T1, on B2 if from T2.
+static void arc_evict(struct proc *p, struct page_data *page){
+  if (page->va / PGSIZE >= MAX_TOTAL_PAGES)
+    return;
+  p->ghost[page->va / PGSIZE] = page->list;
+  p->ghost_time[page->va / PGSIZE] = p->fifo_counter++;
+}
+#endif
+
 int get_SCFIFO_index(){
-  struct proc *p = myproc();
+  struct proc *p = mmproc();
   struct page_data *page;
   pte_t *pte;;
   int page_num = 0;
@@ -793,9 +1358,7 @@ int get_SCFIFO_index(){
   while(!found){
     // find the page that was least recently accessed
     for(page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++){
-      pte = walk(p->pagetable, page->va, 0);
-      
-      if (!(*pte & PTE_U))
+      if (!evictable(p, page))
         continue;
       
       if (first || page->fifo_time < time){
@@ -811,7 +1374,7 @@ int get_SCFIFO_index(){
     if(*pte & PTE_A){
       first = 1;
       page_num = 0;
-      *pte &= ~(PTE_A);
+      __sync_fetch_and_and(pte, ~PTE_A);
       page->fifo_time = p->fifo_counter++;
     }
     else {
@@ -822,8 +1385,134 @@ int get_SCFIFO_index(){
   return page_num;
 }
 
-int exchange_pages(uint64 va_on_swap, int in_swap){
-    struct proc *p = myproc();
+#ifdef ADAPT
+// ADAPT: each process runs SCFIFO, NFUA or LAPA, and moves to
+// another one when it would clearly fault less. at every eviction
+// each of the others names the page it would have evicted, and
+// the page is marked in p->adapt.shadow. a policy is charged a
+// fault when a page it marked is faulted back in, or is used
+// while still resident. every ADAPT_WINDOW evictions the process
+// switches to the policy charged the fewest faults, if that is
+// under 3/4 of what its own policy was charged, and the counts
+// are halved so that old behaviour fades out.
+
+#define ADAPT_WINDOW 32
+
+static char *policy_names[NPOLICY] = { "SCFIFO", "NFUA", "LAPA" };
+
+// the page SCFIFO would evict, without handing out second
+// chances: the oldest unreferenced page, or else the oldest.
+static int scfifo_peek(struct proc *p){
+  struct page_data *page;
+  int oldest = -1, unref = -1;
+
+  for (page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++){
+    if (!evictable(p, page))
+      continue;
+    int i = (int)(page - p->ram);
+    if (oldest < 0 || page->fifo_time < p->ram[oldest].fifo_time)
+      oldest = i;
+    if ((*walk(p->pagetable, page->va, 0) & PTE_A) == 0 &&
+        (unref < 0 || page->fifo_time < p->ram[unref].fifo_time))
+      unref = i;
+  }
+  if (unref >= 0)
+    return unref;
+  return oldest >= 0 ? oldest : 0;
+}
+
+// the victim of policy; only the SCFIFO one changes any state.
+static int policy_victim(struct proc *p, int policy, int peek){
+  switch (policy){
+  case POLICY_NFUA:
+    return get_NFUA_index();
+  case POLICY_LAPA:
+    return get_LAPA_index();
+  default:
+    return peek ? scfifo_peek(p) : get_SCFIFO_index();
+  }
+}
+
+// charge each policy that marked page i a fault.
+static void charge_shadow(struct adapt *a, int i){
+  for (int q = 0; q < NPOLICY; q++)
+    if (a->shadow[i] & (1 << q))
+      a->est[q]++;
+  a->shadow[i] = 0;
+}
+
+// the page at va was faulted back in.
+void adapt_refault(struct proc *p, uint64 va){
+  struct adapt *a = &p->adapt;
+  int i = va / PGSIZE;
+
+  if (i >= MAX_TOTAL_PAGES)
+    return;
+  charge_shadow(a, i);
+  int dist = a->evictions - a->evict_time[i];
+  a->refault_dist += (dist - (int)a->refault_dist) / 8;
+}
+
+// every ADAPT_WINDOW evictions: move to the policy with the
+// fewest estimated faults if it is clearly better.
+static void adapt_switch(struct proc *p){
+  struct adapt *a = &p->adapt;
+  int best = a->policy;
+
+  for (int q = 0; q < NPOLICY; q++)
+    if (a->est[q] < a->est[best])
+      best = q;
+  if (best != a->policy && a->est[a->policy] >= 4 && a->est[best] * 4 < a->est[a->policy] * 3){
+    printf("pid %d: policy %s -> %s, faults %d vs %d, refault distance %d\n",
+           p->pid, policy_names[a->policy], policy_names[best],
+           a->est[a->policy], a->est[best], a->refault_dist);
+    a->policy = best;
+  }
+  for (int q = 0; q < NPOLICY; q++)
+    a->est[q] /= 2;
+}
+
+// pick the victim with p's policy, marking the pages the
+// others would have picked.
+static int adapt_victim(struct proc *p){
+  struct adapt *a = &p->adapt;
+  struct page_data *page;
+
+  // marked pages used since: those policies would have faulted
+  for (page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++){
+    int i = page->va / PGSIZE;
+    if (!page->used || i >= MAX_TOTAL_PAGES || a->shadow[i] == 0)
+      continue;
+    if ((*walk(p->pagetable, page->va, 0) & PTE_A) || (page->age & (1 << 31)))
+      charge_shadow(a, i);
+  }
+
+  for (int q = 0; q < NPOLICY; q++){
+    if (q == a->policy)
+      continue;
+    page = &p->ram[policy_victim(p, q, 1)];
+    if (page->va / PGSIZE < MAX_TOTAL_PAGES)
+      a->shadow[page->va / PGSIZE] |= 1 << q;
+  }
+  return policy_victim(p, a->policy, 0);
+}
+
+// the page is being evicted under p's own policy.
+static void adapt_evict(struct proc *p, struct page_data *page){
+  struct adapt *a = &p->adapt;
+  int i = page->va / PGSIZE;
+
+  if (i < MAX_TOTAL_PAGES){
+    a->shadow[i] |= 1 << a->policy;
+    a->evict_time[i] = a->evictions;
+  }
+  if (++a->evictions % ADAPT_WINDOW == 0)
+    adapt_switch(p);
+}
+#endif
+
+// the p->ram index of the page the replacement policy evicts next.
+static int pick_victim(struct proc *p){
     int ram_arr_index = 0;
 
     #ifdef NFUA
@@ -838,52 +1527,152 @@ int exchange_pages(uint64 va_on_swap, int in_swap){
       ram_arr_index = get_SCFIFO_index();
     #endif
 
+    #ifdef NRU
+      ram_arr_index = get_NRU_index();
+    #endif
+
+    #ifdef ARC
+      ram_arr_index = get_ARC_index();
+    #endif
+
+    #ifdef MGLRU
+      ram_arr_index = get_MGLRU_index();
+    #endif
+
+    #ifdef ADAPT
+      ram_arr_index = adapt_victim(p);
+    #endif
+
+    // sequential pages already passed over go first
+    int behind = get_behind_index(p);
+    if (behind >= 0)
+      ram_arr_index = behind;
+
+    return ram_arr_index;
+}
+
+int exchange_pages(uint64 va_on_swap, int in_swap){
+    struct proc *p = mmproc();
+    int ram_arr_index = pick_victim(p);
+
+    #ifdef ARC
+      arc_evict(p, &p->ram[ram_arr_index]);
+    #endif
+
+    #ifdef ADAPT
+      adapt_evict(p, &p->ram[ram_arr_index]);
+    #endif
+
     int va_on_ram = p->ram[ram_arr_index].va;
     return swap_pages(va_on_swap, va_on_ram, in_swap);
 }
 
+// clustered page-out: evict the policy's victim together with
+// the evictable pages of its run that weren't accessed lately.
+// the run shares one swap cluster, so the pages go out in a
+// single sequential write, and the next few faults find free
+// frames without evicting again.
+// returns the p->ram index freed by the victim, or -1 if there
+// was no room in the swapfile or the write failed.
+static int page_out(struct proc *p){
+  int idx[SWAP_CLUSTER];
+  int n = 0, room = swap_room(p);
+
+  if (room <= 0)
+    return -1;
+  idx[n++] = pick_victim(p);
+  if (!evictable(p, &p->ram[idx[0]]))
+    return -1;
+
+  uint64 run = p->ram[idx[0]].va / PGSIZE / SWAP_CLUSTER;
+  for (int i = 0; i < MAX_PSYC_PAGES && n < room && n < SWAP_CLUSTER; i++){
+    struct page_data *page = &p->ram[i];
+    if (i == idx[0] || !evictable(p, page) || page->va / PGSIZE / SWAP_CLUSTER != run)
+      continue;
+    if (*walk(p->pagetable, page->va, 0) & PTE_A)
+      continue;
+    idx[n++] = i;
+  }
+
+  if (page_out_batch(p, idx, n) < 0)
+    return -1;
+  return idx[0];
+}
+
+// did another thread of the address space bring the page in
+// while this one waited for vm_lock()? only if pte now allows
+// the access that faulted.
+static int resolved(pte_t pte, uint64 scause){
+  uint64 need = scause == 12 ? PTE_X : scause == 13 ? PTE_R : PTE_W;
+
+  return (pte & (PTE_V | PTE_U | need)) == (PTE_V | PTE_U | need) && PTE2PA(pte) != 0;
+}
+
 void handle_NONE(){
     pte_t *pte; 
     uint64 va = PGROUNDDOWN(r_stval());
-    struct proc *p = myproc();
+    uint64 scause = r_scause();
+    struct proc *p = mmproc();
 
     if(va > MAXVA){
       exit(-1);
     }
     
+    vm_lock(p);
     if ((pte = walk(p->pagetable, va, 0)) != 0){
       if ((*pte & PTE_V) && (walkaddr(p->pagetable,va) == 0)){
-        if (uvmalloc(p->pagetable, va, va + PGSIZE) == 0)
-          panic ("uvmalloc failure");
+        // on failure uvmalloc() has picked an out-of-memory
+        // victim; the fault is taken again once it is gone
+        uvmalloc(p->pagetable, va, va + PGSIZE);
       }
-      else {
-        p->killed = 1;
+      else if (!resolved(*pte, scause)) {
+        myproc()->killed = 1;
       }
     }
     else {
-      p->killed = 1;
+      myproc()->killed = 1;
     }
+    vm_unlock(p);
 }
 
 void handle_not_NONE(){
   pte_t *pte;
   uint64 va = PGROUNDDOWN(r_stval());
-  struct proc *p = myproc();
+  uint64 scause = r_scause();
+  struct proc *p = mmproc();
+
+  vm_lock(p);
+  p->fault_va = va;
 
   if ((pte = walk(p->pagetable, va, 0)) != 0){
     if (*pte & PTE_PG){
-      swap(va, pte);
+      if (swap(va, pte) == 0)
+        readahead(p, va);
+      else
+        out_of_memory(p);
     }
-    else {
-      p->killed = 1;
+    else if (*pte & PTE_DZ){
+      int r = zero_fill(va, pte);
+      if (r == SWAPQUOTA)
+        myproc()->killed = 1; // its memory group is full
+      else if (r < 0)
+        out_of_memory(p);
+    }
+    else if (!resolved(*pte, scause)) {
+      myproc()->killed = 1;
     }       
   }
   else {
-    p->killed = 1;
+    myproc()->killed = 1;
   }
+  vm_unlock(p);
 }
 
 void handle_page_fault(){
+  stall_begin();
+  myproc()->faults++;
+  pressure_fault();
+
   #ifdef NONE
     handle_NONE();
   #endif
@@ -891,30 +1680,339 @@ void handle_page_fault(){
   #ifndef NONE
     handle_not_NONE();
   #endif
+
+  stall_end();
+}
+
+// bring the swapped page at va into ram.
+// returns 0 on success, -1 if out of memory.
+int swap(uint64 va, pte_t *pte){
+  struct proc *p = mmproc();
+  int r;
+
+  if (can_grow(p)) { 
+    // swap page from swapfile into the available space in p->ram
+    r = swapfile_to_ram(va, pte, free_ram_index(p));
+  }
+  else if (swap_room(p) > 0) {
+    // make room with a clustered page-out, then swap in
+    if ((r = page_out(p)) >= 0)
+      r = swapfile_to_ram(va, pte, r);
+  }
+  else {
+    // swap between a page in RAM to a page in swapfile
+    r = exchange_pages(va, 1);
+  }
+  mg_sync(p);
+  return r < 0 ? -1 : 0;
 }
 
-void swap(uint64 va, pte_t *pte){
-  struct proc *p = myproc();
+// index of the first free entry in p->ram, or -1 if it is full.
+int free_ram_index(struct proc *p){
+  struct page_data *page_data;
 
-  if (count_pages(p->ram, 1) < MAX_PSYC_PAGES) { 
+  for (page_data = p->ram; page_data < &p->ram[MAX_PSYC_PAGES]; page_data++)
+    if (page_data->used == 0)
+      return (int)(page_data - p->ram);
+  return -1;
+}
 
-    // find first available space in p->ram
-    int ram_arr_index = -1;
-    struct page_data *page_data;
-    for (page_data = p->ram; page_data < &p->ram[MAX_PSYC_PAGES]; page_data++) {
-      if (page_data->used == 0) {
-        ram_arr_index = (int)(page_data - p->ram);
-        break;
+// a page dropped by MADV_DONTNEED was touched again:
+// give it a fresh zeroed frame.
+// returns 0 on success, SWAPQUOTA or -1 as get_ram_slot().
+int zero_fill(uint64 va, pte_t *pte){
+  struct proc *p = mmproc();
+  int ram_arr_index;
+  char *mem;
+
+  if ((ram_arr_index = get_ram_slot(p, va)) < 0)
+    return ram_arr_index;
+
+  if ((mem = kzalloc()) == 0)
+    return -1;
+
+  if (mappage(p->pagetable, va, (uint64)mem, PTE_FLAGS(*pte) & (PTE_R | PTE_W | PTE_X | PTE_U)) != 0){
+    kfree(mem);
+    return -1;
+  }
+  init_page(p, &p->ram[ram_arr_index], va);
+  mg_sync(p);
+  return 0;
+}
+
+// an allocation for p failed. kill the process with the largest
+// footprint and, unless that is p, let it run so its memory is
+// free by the time p tries again. if there is none to kill, the
+// caller is: it would only fail the same way again.
+static void out_of_memory(struct proc *p){
+  if (p == 0 || p->killed)
+    return;
+  if (oom_kill() < 0){
+    myproc()->killed = 1;
+    return;
+  }
+  if (!p->killed)
+    yield();
+}
+
+// can p take one more frame without evicting one of its own
+// pages? not when p->ram is full, nor when p's memory group is
+// at its limit -- unless p has nothing it could evict.
+int can_grow(struct proc *p){
+  struct page_data *page;
+
+  if (free_ram_index(p) < 0)
+    return 0;
+  if (!mg_full(p))
+    return 1;
+  for (page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++)
+    if (page->used && evictable(p, page))
+      return 0;
+  return 1;
+}
+
+// find a p->ram entry for a new page at va that doesn't come
+// from the swapfile, evicting a page if p can't grow. returns
+// the index; SWAPQUOTA if the eviction would go over the swap
+// limit of p's memory group; or -1 if page_out() failed.
+int get_ram_slot(struct proc *p, uint64 va){
+  if (can_grow(p))
+    return free_ram_index(p);
+  if (mg_swap_full(p))
+    return SWAPQUOTA;
+  return page_out(p);
+}
+
+// the resident MADV_SEQUENTIAL page furthest behind the last
+// page fault, or -1 if there is none. such pages have already
+// been passed over and are the cheapest to give up.
+int get_behind_index(struct proc *p){
+  struct page_data *page;
+  int page_num = -1;
+
+  for (page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++){
+    if (!page->used || page->va >= p->fault_va)
+      continue;
+    if (p->advice[page->va / PGSIZE] != MADV_SEQUENTIAL)
+      continue;
+    if (!evictable(p, page))
+      continue;
+    if (page_num < 0 || page->va < p->ram[page_num].va)
+      page_num = (int)(page - p->ram);
+  }
+  return page_num;
+}
+
+// after va was swapped in, bring in the swapped pages that
+// follow it. MADV_SEQUENTIAL pages read further ahead and may
+// push out pages already passed over; MADV_NORMAL pages only
+// use free frames; MADV_RANDOM pages get no readahead.
+void readahead(struct proc *p, uint64 va){
+  int advice = p->advice[va / PGSIZE];
+  int window = 0;
+  pte_t *pte;
+
+  if (advice == MADV_SEQUENTIAL)
+    window = 4;
+  else if (advice == MADV_NORMAL)
+    window = 1;
+
+  for (uint64 a = va + PGSIZE; a < va + (window + 1) * PGSIZE && a < p->sz; a += PGSIZE){
+    if (p->advice[a / PGSIZE] != advice)
+      break;
+    if ((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_PG) == 0)
+      continue;
+    if (!can_grow(p) && (advice != MADV_SEQUENTIAL || get_behind_index(p) < 0))
+      break;
+    if (swap(a, pte) < 0)
+      break;
+  }
+}
+
+// apply advice to the pages in [addr, addr+len).
+// returns 0 on success, -1 on a bad range or advice.
+int madvise(uint64 addr, uint64 len, int advice){
+  struct proc *p = mmproc();
+  uint64 a, last;
+  pte_t *pte;
+  #ifndef NONE
+    int n = 0;
+  #endif
+
+  if (addr % PGSIZE != 0 || addr + len < addr || addr + len > p->sz)
+    return -1;
+  if (advice < MADV_NORMAL || advice > MADV_DONTNEED)
+    return -1;
+  if (len == 0)
+    return 0;
+
+  last = PGROUNDDOWN(addr + len - 1);
+  for (a = addr; a <= last; a += PGSIZE){
+    if ((pte = walk(p->pagetable, a, 0)) == 0)
+      continue;
+
+    #ifdef NONE
+      if (advice == MADV_DONTNEED && (*pte & PTE_U) && PTE2PA(*pte) != 0){
+        // back to an untouched lazy page
+        uint64 pa = PTE2PA(*pte);
+        rmap_remove(pa, p->pagetable, a);
+        *pte = PTE_V;
+        tlb_shootdown(p->pagetable);
+        kfree((void*)pa);
+      }
+      else if (advice == MADV_WILLNEED && PTE_FLAGS(*pte) == PTE_V && PTE2PA(*pte) == 0){
+        if (uvmalloc(p->pagetable, a, a + PGSIZE) == 0)
+          return -1;
+      }
+    #endif
+
+    #ifndef NONE
+      if (p->pid <= 2 || (*pte & PTE_U) == 0)
+        continue;
+
+      if (advice == MADV_DONTNEED){
+        if (*pte & PTE_PG){
+          for (int i = 0; i < MAX_PSYC_PAGES; i++)
+            if (p->swap[i].used && p->swap[i].va == a)
+              remove_page(&p->swap[i]);
+          *pte = (*pte & ~PTE_PG) | PTE_DZ;
+        }
+        else if (*pte & PTE_V){
+          int locked = 0;
+          for (int i = 0; i < MAX_PSYC_PAGES; i++)
+            if (p->ram[i].used && p->ram[i].va == a)
+              locked = p->ram[i].locked;
+          // pinned pages stay as they are
+          if (locked)
+            continue;
+          for (int i = 0; i < MAX_PSYC_PAGES; i++)
+            if (p->ram[i].used && p->ram[i].va == a)
+              remove_page(&p->ram[i]);
+          uint64 pa = PTE2PA(*pte);
+          rmap_remove(pa, p->pagetable, a);
+          *pte = (PTE_FLAGS(*pte) & ~(PTE_V | PTE_A)) | PTE_DZ;
+          tlb_shootdown(p->pagetable);
+          kfree((void*)pa);
+        }
+        // the contents are gone: touching the page again is a
+        // first use, not a sign it was evicted too early
+        #ifdef ARC
+          if (a / PGSIZE < MAX_TOTAL_PAGES)
+            p->ghost[a / PGSIZE] = 0;
+        #endif
+        #ifdef ADAPT
+          if (a / PGSIZE < MAX_TOTAL_PAGES)
+            p->adapt.shadow[a / PGSIZE] = 0;
+        #endif
+      }
+      else if (advice == MADV_WILLNEED){
+        // swapped in right away, by the caller. a kernel thread
+        // can't do it: the swap-in and eviction paths work on
+        // the address space of mmproc() and the swapfile's
+        // inode, and would have to run under the caller's
+        // vm_lock anyway, stopping its next fault all the same.
+        // more than MAX_PSYC_PAGES would only push out the pages
+        // brought in first.
+        if ((*pte & PTE_PG) && n++ < MAX_PSYC_PAGES && swap(a, pte) < 0)
+          break;
+      }
+      else {
+        p->advice[a / PGSIZE] = advice;
       }
+    #endif
+  }
+  sfence_vma();
+  #ifndef NONE
+    mg_sync(p);
+  #endif
+  return 0;
+}
+
+// the p->ram entry of the resident page at va, or 0.
+static struct page_data *ram_page(struct proc *p, uint64 va){
+  struct page_data *page;
+
+  for (page = p->ram; page < &p->ram[MAX_PSYC_PAGES]; page++)
+    if (page->used && page->va == va)
+      return page;
+  return 0;
+}
+
+// pin the pages in [addr, addr+len) in memory, bringing
+// in any that are swapped out or dropped. fails without
+// locking anything if that would take the process over
+// MAX_LOCKED_PAGES. returns 0 on success, -1 on error.
+int mlock(uint64 addr, uint64 len){
+  struct proc *p = mmproc();
+  struct page_data *page;
+  uint64 a, last;
+  pte_t *pte;
+  int n = 0;
+
+  if (addr % PGSIZE != 0 || addr + len < addr || addr + len > p->sz)
+    return -1;
+  if (len == 0)
+    return 0;
+  last = PGROUNDDOWN(addr + len - 1);
+
+  #ifdef NONE
+    // nothing is ever evicted; just populate the range.
+    for (a = addr; a <= last; a += PGSIZE){
+      if ((pte = walk(p->pagetable, a, 0)) != 0 && PTE_FLAGS(*pte) == PTE_V && PTE2PA(*pte) == 0)
+        if (uvmalloc(p->pagetable, a, a + PGSIZE) == 0)
+          return -1;
     }
-    if (ram_arr_index < 0)
-      panic ("error: too many pages in RAM");
+    return 0;
+  #endif
 
-    // swap page from swapfile into the available space in p->ram
-    swapfile_to_ram(va, pte, ram_arr_index);
+  if (p->pid <= 2)
+    return 0;
+
+  for (a = addr; a <= last; a += PGSIZE){
+    if ((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_U) == 0)
+      return -1;
+    if ((page = ram_page(p, a)) == 0 || !page->locked)
+      n++;
   }
-  else {
-    // swap between a page in RAM to a page in swapfile
-    exchange_pages(va, 1);
+  if (p->nlocked + n > MAX_LOCKED_PAGES)
+    return -1;
+
+  for (a = addr; a <= last; a += PGSIZE){
+    pte = walk(p->pagetable, a, 0);
+    // out of memory: the pages locked so far stay locked
+    if ((*pte & PTE_PG) && swap(a, pte) < 0)
+      return -1;
+    if ((*pte & PTE_DZ) && zero_fill(a, pte) < 0)
+      return -1;
+
+    if ((page = ram_page(p, a)) == 0)
+      panic("mlock: page not resident");
+    if (!page->locked){
+      page->locked = 1;
+      p->nlocked++;
+    }
   }
-}
\ No newline at end of file
+  return 0;
+}
+
+// let the pages in [addr, addr+len) be evicted again.
+// returns 0 on success, -1 on a bad range.
+int munlock(uint64 addr, uint64 len){
+  struct proc *p = mmproc();
+  struct page_data *page;
+  uint64 a, last;
+
+  if (addr % PGSIZE != 0 || addr + len < addr || addr + len > p->sz)
+    return -1;
+  if (len == 0)
+    return 0;
+  last = PGROUNDDOWN(addr + len - 1);
+
+  for (a = addr; a <= last; a += PGSIZE){
+    if ((page = ram_page(p, a)) != 0 && page->locked){
+      page->locked = 0;
+      p->nlocked--;
+    }
+  }
+  return 0;
+}
@@ -3,6 +3,7 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 #include "kernel/param.h"
+#include "kernel/mman.h"
 
 #define PGSIZE 4096
 
@@ -101,12 +102,34 @@ void exec_test()
 }
 
 // checks allocation of more pages than process size
+// fails without taking the kernel down
 void allocate_35_pages()
 {
   printf("------ started allocate_35_pages TEST ------\n");
-  printf("panic expected...\n");
-  sbrk(PGSIZE * 35);
-  printf("--- TEST allocate_35_pages done ---\n");
+  if (fork() == 0)
+  {
+    char *heap = sbrk(0);
+#ifndef NONE
+    if (sbrk(PGSIZE * 35) != (char *)-1)
+    {
+      printf("Test failed: sbrk beyond 32 pages succeeded\n");
+      exit(1);
+    }
+#endif
+    if (sbrk(PGSIZE) != heap)
+    {
+      printf("Test failed: sbrk after failure\n");
+      exit(1);
+    }
+    heap[0] = 'a';
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST allocate_35_pages done ---\n");
+  }
 }
 
 // checks access to a deallocated page
@@ -156,6 +179,1269 @@ void swapped_pages_values()
   }
 }
 
+// checks that evicting pages in a child, which goes through the
+// reverse map, leaves the parent's mappings of the same virtual
+// addresses alone. then eight processes with the same virtual
+// addresses page at once, so that the reverse map's chains hold
+// frames of several page tables: each eviction must update and
+// drop the mapping of its own frame in its own page table only.
+void rmap_test()
+{
+  printf("--- ------------ started rmap_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    char *ptrs = (char *)sbrk(24 * PGSIZE);
+    for (int i = 0; i < 24; i++)
+      ptrs[i * PGSIZE] = 'p';
+    if (fork() == 0)
+    {
+      for (int i = 0; i < 24; i++)
+        ptrs[i * PGSIZE] = 'c';
+      for (int i = 0; i < 24; i++)
+      {
+        if (ptrs[i * PGSIZE] != 'c')
+          exit(1);
+      }
+      exit(0);
+    }
+    int status;
+    wait(&status);
+    for (int i = 0; i < 24; i++)
+    {
+      if (ptrs[i * PGSIZE] != 'p')
+      {
+        printf("Test failed - parent page %d has %c\n", i, ptrs[i * PGSIZE]);
+        exit(1);
+      }
+    }
+    if (status != 0)
+    {
+      printf("Test failed - child lost its values\n");
+      exit(1);
+    }
+    for (int n = 0; n < 8; n++)
+    {
+      if (fork() == 0)
+      {
+        for (int i = 0; i < 24; i++)
+          ptrs[i * PGSIZE] = n + i;
+        for (int pass = 0; pass < 4; pass++)
+        {
+          for (int i = 23; i >= 0; i--)
+          {
+            if (ptrs[i * PGSIZE] != n + i)
+              exit(1);
+          }
+        }
+        exit(0);
+      }
+    }
+    for (int n = 0; n < 8; n++)
+    {
+      if (wait(&status) < 0 || status != 0)
+      {
+        printf("Test failed - a process paging with the others lost its values\n");
+        exit(1);
+      }
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST rmap_test done ---\n");
+  }
+}
+
+// the figure key=<n> on the self line of the pressure device.
+int selfstat(char *key)
+{
+  char buf[256], *s;
+  int fd, n, len = strlen(key);
+
+  // the kernel can't read the name out of a swapped-out page
+  strcpy(buf, "pressure");
+  if ((fd = open(buf, 0)) < 0)
+    return -1;
+  n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n < 0)
+    return -1;
+  buf[n] = 0;
+  if ((s = strchr(buf, '\n')) == 0)
+    return -1;
+  for (s++; *s && *s != '\n'; s++)
+  {
+    if (memcmp(s, key, len) == 0 && s[len] == '=')
+      return atoi(s + len + 1);
+  }
+  return -1;
+}
+
+// checks that page-table pages are given back when the memory
+// they map is: growing and shrinking the heap leaves the page
+// table as big as it was
+void ptfree_test()
+{
+  printf("--- ------------ started ptfree_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    // without paging the heap can grow past the level-0 page
+    // tables of the program into ones of its own
+#ifdef NONE
+    int npages = 1024;
+#else
+    int npages = 16;
+#endif
+    int before = selfstat("ptpages");
+    for (int round = 0; round < 3; round++)
+    {
+      char *ptrs = sbrk(npages * PGSIZE);
+      for (int i = 0; i < npages; i++)
+        ptrs[i * PGSIZE] = i;
+      sbrk(-npages * PGSIZE);
+    }
+    int after = selfstat("ptpages");
+    if (before <= 0 || after != before)
+    {
+      printf("Test failed - %d page-table pages before, %d after\n", before, after);
+      exit(1);
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST ptfree_test done ---\n");
+  }
+}
+
+// checks that the pressure device reads from its start on every
+// open, and that the pressure stays a per-mille figure
+void pressure_test()
+{
+  printf("--- ------------ started pressure_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    char buf[256];
+    for (int round = 0; round < 3; round++)
+    {
+      int fd = open("pressure", 0);
+      if (fd < 0)
+      {
+        printf("Test failed - cannot open pressure\n");
+        exit(1);
+      }
+      int n = read(fd, buf, sizeof(buf) - 1);
+      close(fd);
+      if (n < 9 || memcmp(buf, "some avg=", 9) != 0)
+      {
+        printf("Test failed - read %d bytes on open %d\n", n, round);
+        exit(1);
+      }
+      buf[n] = 0;
+      int avg = atoi(buf + 9);
+      if (avg < 0 || avg > 1000)
+      {
+        printf("Test failed - pressure %d is not per mille\n", avg);
+        exit(1);
+      }
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST pressure_test done ---\n");
+  }
+}
+
+// checks that MADV_DONTNEED pages come back zeroed and
+// MADV_WILLNEED brings swapped pages back with their values
+void madvise_test()
+{
+  printf("--- ------------ started madvise_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    char *ptrs = (char *)sbrk(24 * PGSIZE);
+    for (int i = 0; i < 24; i++)
+    {
+      ptrs[i * PGSIZE] = i + '0';
+    }
+    if (madvise(ptrs, 4 * PGSIZE, MADV_DONTNEED) < 0)
+    {
+      printf("Test failed - madvise(MADV_DONTNEED) returned -1\n");
+      exit(1);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+      if (ptrs[i * PGSIZE] != 0)
+      {
+        printf("Test failed - page %d was not zeroed after MADV_DONTNEED\n", i);
+        exit(1);
+      }
+    }
+    madvise(ptrs, 24 * PGSIZE, MADV_WILLNEED);
+    for (int i = 4; i < 24; i++)
+    {
+      if (ptrs[i * PGSIZE] != i + '0')
+      {
+        printf("Test failed - value %c was written on page %d\n", ptrs[i * PGSIZE], i);
+        exit(1);
+      }
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST madvise_test done ---\n");
+  }
+}
+
+// checks that mlock()ed pages keep their values under eviction
+// and that the per-process locked page limit is enforced
+void mlock_test()
+{
+  printf("--- ------------ started mlock_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    char *ptrs = (char *)sbrk(24 * PGSIZE);
+    if (mlock(ptrs, (MAX_LOCKED_PAGES + 1) * PGSIZE) == 0)
+    {
+      printf("Test failed - locked more than MAX_LOCKED_PAGES pages\n");
+      exit(1);
+    }
+    if (mlock(ptrs, 4 * PGSIZE) < 0)
+    {
+      printf("Test failed - mlock returned -1\n");
+      exit(1);
+    }
+    for (int i = 0; i < 24; i++)
+    {
+      ptrs[i * PGSIZE] = i + '0';
+    }
+    for (int i = 0; i < 24; i++)
+    {
+      if (ptrs[i * PGSIZE] != i + '0')
+      {
+        printf("Test failed - value %c was written on page %d\n", ptrs[i * PGSIZE], i);
+        exit(1);
+      }
+    }
+    munlock(ptrs, 4 * PGSIZE);
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST mlock_test done ---\n");
+  }
+}
+
+// checks that a read-mostly working set larger than memory costs
+// fewer swapfile writes than page faults. SCFIFO writes every
+// victim out, one write per fault; NRU evicts clean pages, whose
+// copy in the swapfile is still good, without writing them.
+void nru_test()
+{
+  printf("--- ------------ started nru_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    char *ptrs = (char *)sbrk(24 * PGSIZE);
+    for (int i = 0; i < 24; i++)
+      ptrs[i * PGSIZE] = i;
+    int faults = selfstat("faults");
+    int writes = selfstat("writes");
+    int sum = 0;
+    for (int pass = 0; pass < 4; pass++)
+    {
+      for (int i = 0; i < 24; i++)
+        sum += ptrs[i * PGSIZE];
+    }
+    faults = selfstat("faults") - faults;
+    writes = selfstat("writes") - writes;
+    printf("%d swap writes for %d faults\n", writes, faults);
+    if (sum != 4 * 23 * 24 / 2)
+    {
+      printf("Test failed - read back %d\n", sum);
+      exit(1);
+    }
+#ifdef NRU
+    if (faults <= 0 || writes * 2 >= faults)
+    {
+      printf("Test failed - clean pages were written again\n");
+      exit(1);
+    }
+#endif
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST nru_test done ---\n");
+  }
+}
+
+// checks that pages keep their values while a process runs
+// through many ADAPT windows, switching policy or not, and that
+// it always runs one of the policies
+void adapt_test()
+{
+  printf("--- ------------ started adapt_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    char *ptrs = (char *)sbrk(24 * PGSIZE);
+    for (int i = 0; i < 24; i++)
+      ptrs[i * PGSIZE] = i;
+    // a loop over more pages than fit faults on nearly every
+    // access under FIFO, a few hundred evictions in all
+    for (int pass = 0; pass < 8; pass++)
+    {
+      for (int i = 0; i < 24; i++)
+      {
+        if (ptrs[i * PGSIZE] != i + pass)
+        {
+          printf("Test failed - page %d is %d in pass %d\n", i, ptrs[i * PGSIZE], pass);
+          exit(1);
+        }
+        ptrs[i * PGSIZE]++;
+      }
+#ifdef ADAPT
+      int policy = selfstat("policy");
+      if (policy < 0 || policy > 2)
+      {
+        printf("Test failed - policy %d in pass %d\n", policy, pass);
+        exit(1);
+      }
+#endif
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST adapt_test done ---\n");
+  }
+}
+
+// checks that a hot set stays resident while a larger array is
+// scanned once next to it. the hot pages are used again and again
+// first, with a few fresh pages between uses; then all of the
+// array is read without touching them. a FIFO policy has evicted
+// them by then; ARC has them on T2, out of the scan's way.
+void scan_test()
+{
+  printf("--- ------------ started scan_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    // the hot set gets a swap cluster of its own
+    sbrk((4 - ((uint64)sbrk(0) / PGSIZE) % 4) % 4 * PGSIZE);
+    char *hot = (char *)sbrk(4 * PGSIZE);
+    char *scan = (char *)sbrk(16 * PGSIZE);
+    madvise(scan, 16 * PGSIZE, MADV_DONTNEED);
+    for (int round = 0; round < 3; round++)
+    {
+      for (int i = 0; i < 16; i += 2)
+      {
+        for (int j = 0; j < 4; j++)
+          hot[j * PGSIZE] = 'a' + j + round;
+        scan[i * PGSIZE] = i;
+        scan[(i + 1) * PGSIZE] = i + 1;
+      }
+      madvise(scan, 16 * PGSIZE, MADV_DONTNEED);
+    }
+    for (int i = 0; i < 16; i++)
+      scan[i * PGSIZE] = i;
+    int faults = selfstat("faults");
+    for (int i = 0; i < 4; i++)
+    {
+      if (hot[i * PGSIZE] != 'a' + i + 2)
+      {
+        printf("Test failed - hot page %d has %c\n", i, hot[i * PGSIZE]);
+        exit(1);
+      }
+    }
+    faults = selfstat("faults") - faults;
+    printf("%d faults on the hot set after the scan\n", faults);
+    for (int i = 0; i < 16; i++)
+    {
+      if (scan[i * PGSIZE] != i)
+      {
+        printf("Test failed - scanned page %d has %d\n", i, scan[i * PGSIZE]);
+        exit(1);
+      }
+    }
+#ifdef ARC
+    if (faults != 0)
+    {
+      printf("Test failed - the scan pushed out the hot set\n");
+      exit(1);
+    }
+#endif
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST scan_test done ---\n");
+  }
+}
+
+// checks that pages in use stay resident while a stream of pages
+// used only once goes through memory. the hot set is touched
+// before every new page; the new pages are dropped with
+// MADV_DONTNEED after each pass, so every touch of one is a fresh
+// zero-fill fault. MGLRU keeps the hot set in its young
+// generations and evicts the stream from the old ones.
+void mglru_test()
+{
+  printf("--- ------------ started mglru_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    char *hot = (char *)sbrk(4 * PGSIZE);
+    char *stream = (char *)sbrk(16 * PGSIZE);
+    int faults = 0;
+    for (int pass = 0; pass < 3; pass++)
+    {
+      madvise(stream, 16 * PGSIZE, MADV_DONTNEED);
+      if (pass == 1)
+        faults = selfstat("faults");
+      for (int i = 0; i < 16; i++)
+      {
+        for (int j = 0; j < 4; j++)
+          hot[j * PGSIZE] = 'a' + j;
+        stream[i * PGSIZE] = i;
+      }
+    }
+    // all but the 32 stream faults of the last two passes
+    faults = selfstat("faults") - faults - 32;
+    printf("%d faults besides the stream\n", faults);
+    for (int j = 0; j < 4; j++)
+    {
+      if (hot[j * PGSIZE] != 'a' + j)
+      {
+        printf("Test failed - hot page %d has %c\n", j, hot[j * PGSIZE]);
+        exit(1);
+      }
+    }
+#ifdef MGLRU
+    if (faults > 4)
+    {
+      printf("Test failed - the stream pushed out pages in use\n");
+      exit(1);
+    }
+#endif
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST mglru_test done ---\n");
+  }
+}
+
+// checks that a working set pushed out while a process runs is
+// read back in when it runs again after sleeping. the set is used
+// across one sleep, so it is the working set of the quanta either
+// side; other pages then push it out and are dropped to make room.
+// the next sleep should find it resident again on waking. a
+// quantum ending in the middle changes the working set, so the
+// test gets a few tries.
+void prepage_test()
+{
+  printf("--- ------------ started prepage_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    char *wset = (char *)sbrk(4 * PGSIZE);
+    char *other = (char *)sbrk(16 * PGSIZE);
+    int faults = 0;
+    for (int try = 0; try < 3; try++)
+    {
+      for (int i = 0; i < 4; i++)
+        wset[i * PGSIZE] = 'a' + i + try;
+      sleep(1);
+      for (int i = 0; i < 4; i++)
+        wset[i * PGSIZE] = 'a' + i + try;
+      for (int i = 0; i < 16; i++)
+        other[i * PGSIZE] = i;
+      madvise(other, 16 * PGSIZE, MADV_DONTNEED);
+      sleep(1);
+      faults = selfstat("faults");
+      for (int i = 0; i < 4; i++)
+      {
+        if (wset[i * PGSIZE] != 'a' + i + try)
+        {
+          printf("Test failed - page %d has %c\n", i, wset[i * PGSIZE]);
+          exit(1);
+        }
+      }
+      faults = selfstat("faults") - faults;
+      printf("%d faults on the working set after sleeping\n", faults);
+      if (faults == 0)
+        break;
+    }
+#ifndef NONE
+    if (faults != 0)
+    {
+      printf("Test failed - the working set was not prepaged\n");
+      exit(1);
+    }
+#endif
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST prepage_test done ---\n");
+  }
+}
+
+// loops over more pages than fit, checking their values.
+void thrash(int seed)
+{
+  char *ptrs = (char *)sbrk(20 * PGSIZE);
+  for (int i = 0; i < 20; i++)
+    ptrs[i * PGSIZE] = seed + i;
+  for (int pass = 0; pass < 20; pass++)
+  {
+    for (int i = 0; i < 20; i++)
+    {
+      if (ptrs[i * PGSIZE] != seed + i)
+      {
+        printf("Test failed - page %d of %d has %d\n", i, seed, ptrs[i * PGSIZE]);
+        exit(1);
+      }
+    }
+  }
+  exit(0);
+}
+
+// checks that processes thrashing together all finish with their
+// values, whether load control swaps one out for a while or not,
+// and that none is left suspended
+void loadctl_test()
+{
+  printf("--- ------------ started loadctl_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    int status;
+    for (int n = 0; n < 3; n++)
+    {
+      if (fork() == 0)
+        thrash(n * 20);
+    }
+    for (int n = 0; n < 3; n++)
+    {
+      if (wait(&status) < 0 || status != 0)
+      {
+        printf("Test failed - a thrashing process failed\n");
+        exit(1);
+      }
+    }
+    char buf[256], *s;
+    strcpy(buf, "pressure");
+    int fd = open(buf, 0);
+    int len = fd < 0 ? -1 : read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len < 0)
+    {
+      printf("Test failed - cannot read pressure\n");
+      exit(1);
+    }
+    buf[len] = 0;
+    for (s = buf; *s && memcmp(s, "suspended=", 10) != 0; s++)
+      ;
+    if (*s == 0 || atoi(s + 10) != 0)
+    {
+      printf("Test failed - processes left suspended: %s\n", s);
+      exit(1);
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST loadctl_test done ---\n");
+  }
+}
+
+// checks that a process in a memory group with a small frame
+// limit still keeps its values, paging against the group limit
+void memgroup_test()
+{
+  printf("--- ------------ started memgroup_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    if (memgroup(8, 0) < 0)
+    {
+      printf("Test failed - memgroup returned -1\n");
+      exit(1);
+    }
+    char *ptrs = (char *)sbrk(20 * PGSIZE);
+    for (int i = 0; i < 20; i++)
+    {
+      ptrs[i * PGSIZE] = i + '0';
+    }
+    for (int i = 0; i < 20; i++)
+    {
+      if (ptrs[i * PGSIZE] != i + '0')
+      {
+        printf("Test failed - value %c was written on page %d\n", ptrs[i * PGSIZE], i);
+        exit(1);
+      }
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST memgroup_test done ---\n");
+  }
+}
+
+// checks the swap slots of pages placed by virtual address: pages
+// swapped out in no particular order are copied whole by fork(),
+// and slots freed by shrinking the heap are used again
+void swapslot_test()
+{
+  printf("--- ------------ started swapslot_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    char *ptrs = (char *)sbrk(20 * PGSIZE);
+    for (int i = 19; i >= 0; i -= 2)
+      ptrs[i * PGSIZE] = 'a' + i;
+    for (int i = 0; i < 20; i += 2)
+      ptrs[i * PGSIZE] = 'a' + i;
+    int child = fork();
+    for (int round = 0; round < 2; round++)
+    {
+      for (int i = 0; i < 20; i++)
+      {
+        if (ptrs[i * PGSIZE] != 'a' + i)
+        {
+          printf("Test failed - page %d has %c in %s\n", i, ptrs[i * PGSIZE], child ? "parent" : "child");
+          exit(1);
+        }
+      }
+      // give back the top half, slots and all, and grow again
+      sbrk(-10 * PGSIZE);
+      sbrk(10 * PGSIZE);
+      for (int i = 10; i < 20; i++)
+        ptrs[i * PGSIZE] = 'a' + i;
+    }
+    if (child == 0)
+      exit(0);
+    int status;
+    if (child < 0 || wait(&status) < 0 || status != 0)
+    {
+      printf("Test failed - the child's copy is wrong\n");
+      exit(1);
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST swapslot_test done ---\n");
+  }
+}
+
+// checks that pages written out in clusters come back whole,
+// with every block of each page intact
+void cluster_test()
+{
+  printf("--- ------------ started cluster_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    char *ptrs = (char *)sbrk(24 * PGSIZE);
+    for (int i = 0; i < 24; i++)
+    {
+      ptrs[i * PGSIZE] = i + '0';
+      ptrs[i * PGSIZE + PGSIZE - 1] = i + 'a';
+    }
+    for (int pass = 0; pass < 2; pass++)
+    {
+      for (int i = 23; i >= 0; i--)
+      {
+        if (ptrs[i * PGSIZE] != i + '0' || ptrs[i * PGSIZE + PGSIZE - 1] != i + 'a')
+        {
+          printf("Test failed - page %d has %c and %c\n", i, ptrs[i * PGSIZE], ptrs[i * PGSIZE + PGSIZE - 1]);
+          exit(1);
+        }
+      }
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST cluster_test done ---\n");
+  }
+}
+
+// checks that runnable processes are not lost between the run
+// queues: more busy children than harts all run to the end, and
+// each is reaped once with its own status
+void runq_test()
+{
+  printf("--- ------------ started runq_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    int seen = 0, status;
+    for (int n = 0; n < 8; n++)
+    {
+      if (fork() == 0)
+      {
+        volatile int spin = 0;
+        for (int i = 0; i < 10000000; i++)
+          spin++;
+        exit(n);
+      }
+    }
+    for (int n = 0; n < 8; n++)
+    {
+      if (wait(&status) < 0 || status < 0 || status >= 8 || (seen & (1 << status)))
+      {
+        printf("Test failed - child %d reaped with status %d\n", n, status);
+        exit(1);
+      }
+      seen |= 1 << status;
+    }
+    if (wait(0) >= 0)
+    {
+      printf("Test failed - more children than forked\n");
+      exit(1);
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST runq_test done ---\n");
+  }
+}
+
+// checks that processes whose working sets are out in the
+// swapfile whenever they wake up are all admitted to run again:
+// each sleeps between loops over more pages than fit, and all
+// finish with their values
+void memsched_test()
+{
+  printf("--- ------------ started memsched_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    int status;
+    for (int n = 0; n < 4; n++)
+    {
+      if (fork() == 0)
+      {
+        char *ptrs = (char *)sbrk(20 * PGSIZE);
+        for (int round = 0; round < 5; round++)
+        {
+          for (int i = 0; i < 20; i++)
+          {
+            if (ptrs[i * PGSIZE] != (round ? n + i : 0))
+            {
+              printf("Test failed - page %d of child %d has %d\n", i, n, ptrs[i * PGSIZE]);
+              exit(1);
+            }
+            ptrs[i * PGSIZE] = n + i;
+          }
+          sleep(1);
+        }
+        exit(0);
+      }
+    }
+    for (int n = 0; n < 4; n++)
+    {
+      if (wait(&status) < 0 || status != 0)
+      {
+        printf("Test failed - a child failed\n");
+        exit(1);
+      }
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST memsched_test done ---\n");
+  }
+}
+
+// checks that sleepers on many channels each wake for their own
+// channel: children block reading pipes of their own, and are
+// woken in reverse order, half by a write and half by kill()
+void waitq_test()
+{
+  printf("--- ------------ started waitq_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    int fds[2], out[8], pids[8], status;
+    char c;
+    for (int n = 0; n < 8; n++)
+    {
+      if (pipe(fds) < 0)
+      {
+        printf("Test failed - pipe failed\n");
+        exit(1);
+      }
+      if ((pids[n] = fork()) == 0)
+      {
+        close(fds[1]);
+        if (read(fds[0], &c, 1) != 1 || c != 'a' + n)
+          exit(1);
+        exit(0);
+      }
+      close(fds[0]);
+      out[n] = fds[1];
+    }
+    sleep(1);
+    for (int n = 7; n >= 0; n--)
+    {
+      c = 'a' + n;
+      if (n % 2)
+        write(out[n], &c, 1);
+      else
+        kill(pids[n]);
+      close(out[n]);
+    }
+    for (int n = 0; n < 8; n++)
+    {
+      int child = wait(&status);
+      int i;
+      for (i = 0; i < 8 && pids[i] != child; i++)
+        ;
+      if (i == 8 || status != (i % 2 ? 0 : -1))
+      {
+        printf("Test failed - child %d exited with %d\n", i, status);
+        exit(1);
+      }
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST waitq_test done ---\n");
+  }
+}
+
+// checks that sleepers wake at their own deadlines, including
+// ones past the first level of the timer wheel that have to
+// cascade down, and that kill() wakes a sleeper long before
+void timer_test()
+{
+  printf("--- ------------ started timer_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    int naps[4] = {1, 5, 70, 130}, status;
+    int sleeper = fork();
+    if (sleeper == 0)
+    {
+      sleep(100000);
+      exit(0);
+    }
+    int start = uptime();
+    sleep(1);
+    kill(sleeper);
+    if (wait(&status) != sleeper || status != -1 || uptime() - start > HZ)
+    {
+      printf("Test failed - kill did not wake a sleeper\n");
+      exit(1);
+    }
+    for (int n = 0; n < 4; n++)
+    {
+      if (fork() == 0)
+      {
+        start = uptime();
+        sleep(naps[n]);
+        int slept = uptime() - start;
+        if (slept < naps[n] || slept > naps[n] + HZ)
+        {
+          printf("Test failed - slept %d ticks for %d\n", slept, naps[n]);
+          exit(1);
+        }
+        exit(0);
+      }
+    }
+    for (int n = 0; n < 4; n++)
+    {
+      if (wait(&status) < 0 || status != 0)
+      {
+        printf("Test failed - a sleeper woke at the wrong time\n");
+        exit(1);
+      }
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST timer_test done ---\n");
+  }
+}
+
+// checks that the clock keeps ticking at HZ while every hart
+// idles, and that work made runnable then still gets a hart:
+// children sleep, with the other harts stopped, and then all
+// need one at once
+void tick_test()
+{
+  printf("--- ------------ started tick_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    int start = uptime(), status;
+    for (int i = 0; i < HZ; i++)
+      sleep(1);
+    int elapsed = uptime() - start;
+    if (elapsed < HZ || elapsed > 3 * HZ)
+    {
+      printf("Test failed - %d ticks for %d sleeps\n", elapsed, HZ);
+      exit(1);
+    }
+    for (int n = 0; n < 4; n++)
+    {
+      if (fork() == 0)
+      {
+        sleep(HZ / 2 + 1);
+        volatile int spin = 0;
+        for (int i = 0; i < 1000000; i++)
+          spin++;
+        exit(0);
+      }
+    }
+    for (int n = 0; n < 4; n++)
+    {
+      if (wait(&status) < 0 || status != 0)
+      {
+        printf("Test failed - a child failed\n");
+        exit(1);
+      }
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST tick_test done ---\n");
+  }
+}
+
+// checks wait(), kill() and reparenting through the child lists
+// and the pid hash: an orphaned grandchild goes to init, not to
+// its grandparent, and is still found by pid to be killed
+void family_test()
+{
+  printf("--- ------------ started family_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    int fds[2], child, grandchild = 0, status;
+    pipe(fds);
+    if ((child = fork()) == 0)
+    {
+      if ((grandchild = fork()) == 0)
+      {
+        sleep(100000);
+        exit(0);
+      }
+      write(fds[1], &grandchild, sizeof(grandchild));
+      exit(7);
+    }
+    if (read(fds[0], &grandchild, sizeof(grandchild)) != sizeof(grandchild) || grandchild <= 0)
+    {
+      printf("Test failed - no grandchild\n");
+      exit(1);
+    }
+    if (wait(&status) != child || status != 7)
+    {
+      printf("Test failed - did not reap the child\n");
+      exit(1);
+    }
+    if (wait(0) != -1)
+    {
+      printf("Test failed - reaped the grandchild\n");
+      exit(1);
+    }
+    if (kill(grandchild) != 0 || kill(100000) != -1)
+    {
+      printf("Test failed - kill by pid\n");
+      exit(1);
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST family_test done ---\n");
+  }
+}
+
+// checks that procs are allocated as needed and reused: rounds
+// of children, all alive at once, each use some memory and wait
+// for the parent to let them go. without paging there are more
+// of them than the old fixed table held; with it, each holds a
+// swapfile open, and the open inodes run out first.
+void procs_test()
+{
+  printf("--- ------------ started procs_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+#ifdef NONE
+    int nchild = 100;
+#else
+    int nchild = 30;
+#endif
+    int fds[2], status;
+    char c;
+    for (int round = 0; round < 3; round++)
+    {
+      pipe(fds);
+      for (int n = 0; n < nchild; n++)
+      {
+        int child = fork();
+        if (child < 0)
+        {
+          printf("Test failed - fork %d of round %d failed\n", n, round);
+          exit(1);
+        }
+        if (child == 0)
+        {
+          close(fds[1]);
+          char *ptrs = (char *)sbrk(4 * PGSIZE);
+          for (int i = 0; i < 4; i++)
+            ptrs[i * PGSIZE] = n;
+          read(fds[0], &c, 1);
+          for (int i = 0; i < 4; i++)
+            if (ptrs[i * PGSIZE] != (char)n)
+              exit(1);
+          exit(0);
+        }
+      }
+      close(fds[0]);
+      close(fds[1]);
+      for (int n = 0; n < nchild; n++)
+      {
+        if (wait(&status) < 0 || status != 0)
+        {
+          printf("Test failed - a child of round %d failed\n", round);
+          exit(1);
+        }
+      }
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST procs_test done ---\n");
+  }
+}
+
+// checks that nice() moves the nice level and keeps it
+// within -20 to 19
+void nice_test()
+{
+  printf("--- ------------ started nice_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    if (nice(5) != 5 || nice(100) != 19 || nice(-100) != -20 || nice(20) != 0 ||
+        nice(0x7fffffff) != 19 || nice(-0x7fffffff - 1) != -20)
+    {
+      printf("Test failed - nice level out of range\n");
+      exit(1);
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST nice_test done ---\n");
+  }
+}
+
+// checks that pages handed out by sbrk come zeroed, also when
+// the frames were dirtied and given back just before
+void zero_test()
+{
+  printf("--- ------------ started zero_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    for (int pass = 0; pass < 3; pass++)
+    {
+      char *ptrs = (char *)sbrk(8 * PGSIZE);
+      for (int i = 0; i < 8 * PGSIZE; i++)
+      {
+        if (ptrs[i] != 0)
+        {
+          printf("Test failed - byte %d of pass %d is %d\n", i, pass, ptrs[i]);
+          exit(1);
+        }
+        ptrs[i] = 'z';
+      }
+      sbrk(-8 * PGSIZE);
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST zero_test done ---\n");
+  }
+}
+
+char *clone_pages;
+
+// writes its half of the shared pages and exits.
+void clone_worker(void *arg)
+{
+  int half = (int)(uint64)arg;
+  for (int i = half * 10; i < half * 10 + 10; i++)
+    clone_pages[i * PGSIZE] = 'a' + i;
+  exit(0);
+}
+
+// two threads fill 20 pages of one address space, which the
+// parent then sees without any copying.
+void clone_test()
+{
+  printf("--- ------------ started clone_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    clone_pages = (char *)sbrk(20 * PGSIZE);
+    char *stack1 = malloc(PGSIZE);
+    char *stack2 = malloc(PGSIZE);
+    if (clone(clone_worker, (void *)0, stack1 + PGSIZE) < 0 ||
+        clone(clone_worker, (void *)1, stack2 + PGSIZE) < 0)
+    {
+      printf("Test failed - clone failed\n");
+      exit(1);
+    }
+    int status;
+    for (int n = 0; n < 2; n++)
+    {
+      if (wait(&status) < 0 || status != 0)
+      {
+        printf("Test failed - thread %d did not exit cleanly\n", n);
+        exit(1);
+      }
+    }
+    for (int i = 0; i < 20; i++)
+    {
+      if (clone_pages[i * PGSIZE] != 'a' + i)
+      {
+        printf("Test failed - page %d is %d\n", i, clone_pages[i * PGSIZE]);
+        exit(1);
+      }
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST clone_test done ---\n");
+  }
+}
+
+int clone_group;
+
+// puts its address space in a new memory group.
+void clone_group_worker(void *arg)
+{
+  clone_group = memgroup(8, 0);
+  exit(clone_group < 0);
+}
+
+// checks that a thread creating a memory group moves the whole
+// address space into it, owner and all
+void clone_group_test()
+{
+  printf("--- ------------ started clone_group_test TEST  ------------\n");
+  int pid;
+  if ((pid = fork()) == 0)
+  {
+    char *stack = malloc(PGSIZE);
+    int status;
+    if (clone(clone_group_worker, 0, stack + PGSIZE) < 0 || wait(&status) < 0 || status != 0)
+    {
+      printf("Test failed - the thread could not create a group\n");
+      exit(1);
+    }
+    if (selfstat("group") != clone_group)
+    {
+      printf("Test failed - the owner is in group %d, not %d\n", selfstat("group"), clone_group);
+      exit(1);
+    }
+    char *ptrs = (char *)sbrk(20 * PGSIZE);
+    for (int i = 0; i < 20; i++)
+      ptrs[i * PGSIZE] = 'a' + i;
+    for (int i = 0; i < 20; i++)
+    {
+      if (ptrs[i * PGSIZE] != 'a' + i)
+      {
+        printf("Test failed - page %d has %c\n", i, ptrs[i * PGSIZE]);
+        exit(1);
+      }
+    }
+    printf("Test passed!!!\n");
+    exit(0);
+  }
+  else
+  {
+    wait(0);
+    printf("--- TEST clone_group_test done ---\n");
+  }
+}
+
 void main(void)
 {
   printf("------------ starting tests  ------------\n");
@@ -163,7 +1449,32 @@ void main(void)
   // swapped_pages_values();
   // alloc_and_dealloc();
   exec_test();
-  // // allocate_35_pages();
+  rmap_test();
+  ptfree_test();
+  pressure_test();
+  madvise_test();
+  mlock_test();
+  memgroup_test();
+  nru_test();
+  scan_test();
+  mglru_test();
+  adapt_test();
+  prepage_test();
+  loadctl_test();
+  swapslot_test();
+  cluster_test();
+  runq_test();
+  memsched_test();
+  waitq_test();
+  timer_test();
+  tick_test();
+  family_test();
+  procs_test();
+  nice_test();
+  zero_test();
+  clone_test();
+  clone_group_test();
+  allocate_35_pages();
   // access_deallocated_page();
   exit(0);
 }
\ No newline at end of file
@@ -23,6 +23,13 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int pressurewait(int);
+int madvise(void*, int, int);
+int mlock(void*, int);
+int munlock(void*, int);
+int memgroup(int, int);
+int nice(int);
+int clone(void (*)(void*), void*, void*);
 
 // ulib.c
 int stat(const char*, struct stat*);
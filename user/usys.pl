@@ -36,3 +36,10 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("pressurewait");
+entry("madvise");
+entry("mlock");
+entry("munlock");
+entry("memgroup");
+entry("nice");
+entry("clone");